@@ -0,0 +1,31 @@
+#ifndef BIOME_LAYER_H
+#define BIOME_LAYER_H
+
+#include <vector>
+
+// Biome noise at quart resolution, one sample per 4×4 columns, matching what
+// Chunk::biomes can store. Each cell is sampled at its last column (x%4 == 3,
+// z%4 == 3), the column whose value per-column setBiomeColumn calls left behind.
+struct BiomeLayer {
+    int x0 = 0, z0 = 0; // window origin in blocks, multiple of 4
+    int qw = 0, qh = 0; // window size in quart cells
+    std::vector<float> values; // qz*qw + qx
+
+    void resize(int x0_, int z0_, int w, int h) {
+        x0 = x0_; z0 = z0_; qw = w / 4; qh = h / 4;
+        values.resize(qw * qh);
+    }
+
+    // noise(x, z) at every cell's sample column of the w×h block window at (x0, z0).
+    template <class F>
+    void evaluate(F noise, int x0_, int z0_, int w, int h) {
+        resize(x0_, z0_, w, h);
+        for (int qz = 0; qz < qh; qz++)
+            for (int qx = 0; qx < qw; qx++) values[qz*qw + qx] = noise(x0 + qx*4 + 3, z0 + qz*4 + 3);
+    }
+
+    // Value for the column at world (x, z), upsampled from its quart cell.
+    float at(int x, int z) const { return values[((z - z0) / 4)*qw + (x - x0) / 4]; }
+};
+
+#endif
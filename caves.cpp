@@ -0,0 +1,122 @@
+#include "caves.h"
+#include "noise.h"
+#include <algorithm>
+#include <vector>
+
+// Fractional lattice offset and fade weight of one axis sample, as hashNoise3 computes them.
+struct Axis {
+    int64_t cell;
+    double f, fade;
+};
+
+static Axis axis(double x) {
+    double fx = std::floor(x), f = x - fx;
+    return {(int64_t)fx, f, f * f * f * (f * (f * 6 - 15) + 10)};
+}
+
+// hashGrad3's gradient as a vector: two of the three components are ±1, the other 0.
+struct Grad {
+    double x, y, z;
+};
+
+static Grad gradOf(uint64_t h) {
+    uint64_t g = h >> 60;
+    double s1 = 1.0 - 2.0 * (double)(g & 1), s2 = 1.0 - 2.0 * (double)((g >> 1) & 1);
+    if (g < 4) return {s1, s2, 0.0};
+    if (g < 8) return {s1, 0.0, s2};
+    if (g == 12 || g == 14) return {s2, s1, 0.0};
+    return {0.0, s1, s2};
+}
+
+// hashNoise3 at the 5×33×5 corners for one octave, added to corner with `amplitude`.
+// Neighbouring corners share lattice cells (12 corners per cell in x and z, 3 in y at
+// the default scale), so the lattice gradients are computed once per lattice point into
+// a small table and every corner reuses them. The dot products add the same two nonzero
+// terms as hashGrad3, so the results are identical to hashNoise3.
+template <int NX, int NY, int NZ>
+static void addOctave(float (&corner)[NZ][NX][NY], const Axis* ax, const Axis* ay, const Axis* az,
+                      uint64_t seed, float amplitude) {
+    const int64_t x0 = ax[0].cell, y0 = ay[0].cell, z0 = az[0].cell;
+    const int LX = (int)(ax[NX-1].cell - x0) + 2, LY = (int)(ay[NY-1].cell - y0) + 2, LZ = (int)(az[NZ-1].cell - z0) + 2;
+    static thread_local std::vector<Grad> grad;
+    grad.resize((size_t)LX * LY * LZ);
+    for (int lz = 0; lz < LZ; lz++)
+        for (int ly = 0; ly < LY; ly++)
+            for (int lx = 0; lx < LX; lx++)
+                grad[((size_t)lz*LY + ly)*LX + lx] = gradOf(hashLattice3(seed, x0 + lx, y0 + ly, z0 + lz));
+
+    for (int k = 0; k < NZ; k++) {
+        for (int i = 0; i < NX; i++) {
+            const Axis &X = ax[i], &Z = az[k];
+            for (int j = 0; j < NY; j++) {
+                const Axis& Y = ay[j];
+                const Grad* g = &grad[((size_t)(Z.cell - z0)*LY + (Y.cell - y0))*LX + (X.cell - x0)];
+                double c[8];
+                for (int n = 0; n < 8; n++) {
+                    int dx = n & 1, dy = (n >> 1) & 1, dz = n >> 2;
+                    const Grad& gn = g[((size_t)dz*LY + dy)*LX + dx];
+                    c[n] = gn.x * (X.f - dx) + gn.y * (Y.f - dy) + gn.z * (Z.f - dz);
+                }
+                double x00 = c[0] + X.fade * (c[1] - c[0]), x10 = c[2] + X.fade * (c[3] - c[2]);
+                double x01 = c[4] + X.fade * (c[5] - c[4]), x11 = c[6] + X.fade * (c[7] - c[6]);
+                double e0 = x00 + Y.fade * (x10 - x00), e1 = x01 + Y.fade * (x11 - x01);
+                corner[k][i][j] += (float)((e0 + Z.fade * (e1 - e0) + 1.0) * 0.5) * amplitude;
+            }
+        }
+    }
+}
+
+void carveCaves(ChunkTile& tile, int cx, int cz, const int* heights, const int* water, const CaveParams& p) {
+    const int NX = 5, NY = 33, NZ = 5;
+    static thread_local float corner[NZ][NX][NY];
+    for (auto& plane : corner)
+        for (auto& row : plane)
+            std::fill(row, row + NY, 0.0f);
+    float amplitude = 1.0f, norm = 0.0f;
+    for (int o = 0; o < p.octaves; o++) {
+        Axis ax[NX], ay[NY], az[NZ];
+        for (int i = 0; i < NX; i++) ax[i] = axis((cx*16 + i*4) * (double)p.scale * (1 << o));
+        for (int k = 0; k < NZ; k++) az[k] = axis((cz*16 + k*4) * (double)p.scale * (1 << o));
+        for (int j = 0; j < NY; j++) ay[j] = axis(j*8 * 2.0 * p.scale * (1 << o));
+        addOctave(corner, ax, ay, az, p.seed + o, amplitude);
+        norm += amplitude;
+        amplitude *= 0.5f;
+    }
+    for (auto& plane : corner)
+        for (auto& row : plane)
+            for (float& v : row) v /= norm;
+
+    static const float kTy[8] = {0.0f, 0.125f, 0.25f, 0.375f, 0.5f, 0.625f, 0.75f, 0.875f};
+    uint8_t water_id = tile.id(block::water.get());
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            // Interpolate the cell corners in x and z to this column's 33 y samples.
+            int i = x / 4, k = z / 4;
+            float tx = (x % 4) * 0.25f, tz = (z % 4) * 0.25f;
+            float col[NY];
+            for (int j = 0; j < NY; j++) {
+                float a = corner[k][i][j] + tx * (corner[k][i+1][j] - corner[k][i][j]);
+                float b = corner[k+1][i][j] + tx * (corner[k+1][i+1][j] - corner[k+1][i][j]);
+                col[j] = a + tz * (b - a);
+            }
+
+            int h = heights[z*16 + x];
+            int top = water[z*16 + x] > h ? h - p.roof : std::min(h, tile.topY);
+            uint8_t* c = tile.column(x, z);
+            // Eight y values per cell; the block bytes are only touched in cells where
+            // some of them exceed the threshold.
+            for (int j = 0; j*8 <= top && j < NY - 1; j++) {
+                float density[8];
+                bool any = false;
+                for (int t = 0; t < 8; t++) density[t] = col[j] + kTy[t] * (col[j+1] - col[j]);
+                for (int t = 0; t < 8; t++) any |= density[t] > p.threshold;
+                if (!any) continue;
+                for (int t = 0; t < 8; t++) {
+                    int y = j*8 + t;
+                    bool carve = y >= 1 && y <= top && density[t] > p.threshold && c[y] != water_id;
+                    c[y] = carve ? 0 : c[y];
+                }
+            }
+        }
+    }
+}
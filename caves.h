@@ -0,0 +1,22 @@
+#ifndef CAVES_H
+#define CAVES_H
+
+#include "mca_generator.h"
+
+// Cave carving from a 3D density field. Noise is sampled only at the corners of
+// 4×8×4 cells (5×33×5 points per chunk, vanilla style) and trilinearly
+// interpolated per block; carving writes straight into the chunk's tile columns.
+struct CaveParams {
+    float scale = 1.0f / 48.0f;   // horizontal noise frequency, vertical is doubled
+    float threshold = 0.64f;      // carve where density exceeds this
+    int octaves = 2;
+    int roof = 4;                 // solid blocks kept under water-covered columns
+    uint64_t seed = 5;
+};
+
+// Carves air into solid blocks of tile (chunk cx, cz). heights and water hold the 16×16
+// surface heights and water levels (z*16 + x); columns under sea or river water keep a
+// roof below the bed. y = 0 is never carved.
+void carveCaves(ChunkTile& tile, int cx, int cz, const int* heights, const int* water, const CaveParams& p);
+
+#endif
@@ -0,0 +1,59 @@
+#include "decoration.h"
+#include "rng.h"
+
+void DecorationBuffer::clear() {
+    for (auto& n : neighbours) n.clear();
+}
+
+void DecorationBuffer::add(int cx, int cz, const BorderWrite& w) {
+    int dx = (w.x >> 4) - cx, dz = (w.z >> 4) - cz;
+    if (dx < -1 || dx > 1 || dz < -1 || dz > 1) return; // decorations reach at most one chunk
+    neighbours[(dz + 1)*3 + (dx + 1)].push_back(w);
+}
+
+void decorateTrees(ChunkTile& tile, int cx, int cz, const int* heights, uint64_t seed, DecorationBuffer& buf) {
+    uint8_t grass = tile.id(block::grass_block.get());
+    uint8_t log = tile.id(block::oak_log.get());
+    uint8_t leaves = tile.id(block::oak_leaves.get());
+    ChunkRng rng(seed, cx, cz, 100);
+
+    auto put = [&](int x, int y, int z, const Block* b, uint8_t id, bool replace_leaves) {
+        if (y < 0 || y > 255) return;
+        if (x >= 0 && x < 16 && z >= 0 && z < 16) {
+            uint8_t& c = tile.column(x, z)[y];
+            if (c == 0 || (replace_leaves && c == leaves)) c = id;
+            tile.topY = std::max(tile.topY, y);
+        } else {
+            buf.add(cx, cz, {cx*16 + x, y, cz*16 + z, b, replace_leaves});
+        }
+    };
+
+    int attempts = rng.range(0, 3);
+    for (int t = 0; t < attempts; t++) {
+        int x = rng.range(0, 15), z = rng.range(0, 15), trunk = rng.range(4, 6);
+        uint32_t shape = rng.next();
+        int h = heights[z*16 + x];
+        if (h + trunk + 2 > 255 || tile.column(x, z)[h] != grass) continue;
+        for (int dy = -2; dy <= 1; dy++) {
+            int r = dy < 0 ? 2 : 1;
+            for (int dz = -r; dz <= r; dz++) {
+                for (int dx = -r; dx <= r; dx++) {
+                    bool corner = (dx == -r || dx == r) && (dz == -r || dz == r);
+                    if (corner && (dy == 1 || (shape >> ((dy + 2)*4 + (dx > 0)*2 + (dz > 0)) & 1))) continue;
+                    put(x + dx, h + trunk + dy, z + dz, block::oak_leaves.get(), leaves, false);
+                }
+            }
+        }
+        for (int y = h + 1; y <= h + trunk; y++) put(x, y, z, block::oak_log.get(), log, true);
+    }
+}
+
+void applyBorderWrites(Chunk& chunk, const std::vector<BorderWrite>& writes) {
+    for (const BorderWrite& w : writes) {
+        int x = w.x & 15, z = w.z & 15;
+        Section* s = chunk.sections[w.y / 16];
+        Block* cur = s ? s->blocks[(w.y % 16)*256 + z*16 + x] : nullptr;
+        if (cur && !(w.replace_leaves && cur == block::oak_leaves.get())) continue;
+        chunk.setBlock(const_cast<Block*>(w.block), x, w.y, z);
+    }
+}
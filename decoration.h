@@ -0,0 +1,49 @@
+#ifndef DECORATION_H
+#define DECORATION_H
+
+#include "mca_generator.h"
+#include <array>
+#include <vector>
+
+// A decoration block that lands outside the chunk that generated it (world coordinates).
+struct BorderWrite {
+    int x, y, z;
+    const Block* block;
+    bool replace_leaves; // logs may replace leaves, everything else only fills air
+};
+
+// Decoration output of one chunk that belongs to its neighbours, one list per
+// neighbour (index (dz+1)*3 + (dx+1), centre unused). Chunks decorate independently
+// and in parallel; the lists are merged into a chunk only after all of its
+// neighbours are finished, like vanilla proto-chunks.
+struct DecorationBuffer {
+    std::array<std::vector<BorderWrite>, 9> neighbours;
+
+    void clear();
+    void add(int cx, int cz, const BorderWrite& w); // cx, cz = owning chunk
+};
+
+// Grows oak trees on grass in chunk (cx, cz). Writes inside the chunk go straight to
+// the tile, the rest into buf. Placement uses ChunkRng, so it does not depend on the
+// order chunks are decorated in.
+void decorateTrees(ChunkTile& tile, int cx, int cz, const int* heights, uint64_t seed, DecorationBuffer& buf);
+
+// Applies buffered writes that fall into chunk: leaves only fill air, logs may also
+// replace leaves.
+void applyBorderWrites(Chunk& chunk, const std::vector<BorderWrite>& writes);
+
+// Applies the writes that chunk (cx, cz)'s 8 neighbours buffered for it, in a fixed
+// neighbour order. buffers(ncx, ncz) returns a neighbour's buffer or null.
+template <class Lookup>
+void mergeBorderWrites(Chunk& chunk, int cx, int cz, Lookup buffers) {
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if (dx == 0 && dz == 0) continue;
+            const DecorationBuffer* src = buffers(cx + dx, cz + dz);
+            // Seen from the source, this chunk is at (-dx, -dz).
+            if (src) applyBorderWrites(chunk, src->neighbours[(1 - dz)*3 + (1 - dx)]);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "density.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+namespace density {
+
+void Params::load(const std::string& fname) {
+    std::ifstream in(fname);
+    if (!in) { std::cerr << "Cannot open " << fname << "\n"; exit(1); }
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        auto trim = [](std::string s) {
+            s.erase(0, s.find_first_not_of(" \t\r"));
+            s.erase(s.find_last_not_of(" \t\r") + 1);
+            return s;
+        };
+        values[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+    }
+}
+
+float Params::get(const std::string& key, float def) const {
+    auto it = values.find(key);
+    return it == values.end() ? def : std::stof(it->second);
+}
+
+std::vector<std::pair<float, float>> Params::points(const std::string& key) const {
+    std::vector<std::pair<float, float>> pts;
+    auto it = values.find(key);
+    if (it == values.end()) return pts;
+    std::istringstream ss(it->second);
+    std::string tok;
+    while (ss >> tok) {
+        size_t c = tok.find(':');
+        if (c == std::string::npos) { std::cerr << "Bad spline point " << tok << " in " << key << "\n"; exit(1); }
+        pts.push_back({std::stof(tok.substr(0, c)), std::stof(tok.substr(c + 1))});
+    }
+    return pts;
+}
+
+}
@@ -0,0 +1,219 @@
+#ifndef DENSITY_H
+#define DENSITY_H
+
+#include "noise.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+// Density-function graph for terrain layers. Nodes are small value types combined
+// with + and * and the helpers below; the whole expression is one template type, so
+// evalTile() compiles it into a single fused loop. Each node works on a batch of
+// kLanes samples held in a Lanes value, so intermediates stay in registers instead
+// of being written out per layer. evalTile() first calls prepare() with the tile,
+// which lets Noise leaves evaluate all of it at once through fbmGrid.
+namespace density {
+
+constexpr int kLanes = 8;
+
+struct Lanes {
+    float v[kLanes];
+};
+
+struct Node { // tag base, enables the operators below
+    void prepare(int, int, int, int, int) {}
+};
+
+struct Const : Node {
+    float value;
+    explicit Const(float v) : value(v) {}
+    Lanes eval(const Lanes&, const Lanes&) const {
+        Lanes r;
+        for (int i = 0; i < kLanes; i++) r.v[i] = value;
+        return r;
+    }
+};
+
+// fBm of (x*scale + dx, z*scale + dz); perlin by default, hashNoise when `hash` is set.
+// Lanes on the prepared tile's grid are read from values fbmGrid computed for all of
+// it; warped lanes fall back to fbm() per lane, with identical results.
+struct Noise : Node {
+    float scale, dx, dz;
+    int octaves;
+    bool hash;
+    uint64_t seed;
+    std::vector<float> grid; // prepared tile, (x0 + i*step, z0 + j*step) at j*grid_w + i
+    int grid_x0 = 0, grid_z0 = 0, grid_w = 0, grid_h = 0, grid_step = 1;
+    Noise(float scale_, int octaves_, float dx_ = 0.0f, float dz_ = 0.0f, bool hash_ = false, uint64_t seed_ = 5)
+        : scale(scale_), dx(dx_), dz(dz_), octaves(octaves_), hash(hash_), seed(seed_) {}
+    void prepare(int x0, int z0, int w, int h, int step) {
+        if (hash) return;
+        int n = (w + kLanes - 1) / kLanes * kLanes;
+        std::vector<float> xs(n), zs(h);
+        for (int i = 0; i < n; i++) xs[i] = (float)(x0 + i*step) * scale + dx;
+        for (int j = 0; j < h; j++) zs[j] = (float)(z0 + j*step) * scale + dz;
+        grid.resize(n * h);
+        fbmGrid(xs.data(), n, zs.data(), h, grid.data(), octaves);
+        grid_x0 = x0; grid_z0 = z0; grid_w = n; grid_h = h; grid_step = step;
+    }
+    Lanes eval(const Lanes& x, const Lanes& z) const {
+        Lanes r;
+        int k = ((int)x.v[0] - grid_x0) / grid_step, j = ((int)z.v[0] - grid_z0) / grid_step;
+        bool on_grid = !grid.empty() && k >= 0 && k + kLanes <= grid_w && j >= 0 && j < grid_h;
+        for (int i = 0; i < kLanes && on_grid; i++)
+            on_grid = z.v[i] == grid_z0 + j*grid_step && x.v[i] == grid_x0 + (k + i)*grid_step;
+        if (on_grid) {
+            for (int i = 0; i < kLanes; i++) r.v[i] = grid[j*grid_w + k + i];
+        } else if (hash) {
+            for (int i = 0; i < kLanes; i++)
+                r.v[i] = fbmHash((double)x.v[i] * scale + dx, (double)z.v[i] * scale + dz, seed, octaves);
+        } else {
+            for (int i = 0; i < kLanes; i++) r.v[i] = fbm(x.v[i] * scale + dx, z.v[i] * scale + dz, octaves);
+        }
+        return r;
+    }
+};
+
+template <class A, class B>
+struct Add : Node {
+    A a; B b;
+    Add(const A& a_, const B& b_) : a(a_), b(b_) {}
+    void prepare(int x0, int z0, int w, int h, int step) { a.prepare(x0, z0, w, h, step); b.prepare(x0, z0, w, h, step); }
+    Lanes eval(const Lanes& x, const Lanes& z) const {
+        Lanes l = a.eval(x, z), r = b.eval(x, z);
+        for (int i = 0; i < kLanes; i++) l.v[i] += r.v[i];
+        return l;
+    }
+};
+
+template <class A, class B>
+struct Mul : Node {
+    A a; B b;
+    Mul(const A& a_, const B& b_) : a(a_), b(b_) {}
+    void prepare(int x0, int z0, int w, int h, int step) {
+        if (!off()) { a.prepare(x0, z0, w, h, step); b.prepare(x0, z0, w, h, step); }
+    }
+    // A layer scaled by a constant 0 is off and never evaluated.
+    bool off() const {
+        if constexpr (std::is_same<B, Const>::value) return b.value == 0.0f;
+        return false;
+    }
+    Lanes eval(const Lanes& x, const Lanes& z) const {
+        if (off()) return b.eval(x, z);
+        Lanes l = a.eval(x, z), r = b.eval(x, z);
+        for (int i = 0; i < kLanes; i++) l.v[i] *= r.v[i];
+        return l;
+    }
+};
+
+template <class A>
+struct Clamp : Node {
+    A a;
+    float lo, hi;
+    Clamp(const A& a_, float lo_, float hi_) : a(a_), lo(lo_), hi(hi_) {}
+    void prepare(int x0, int z0, int w, int h, int step) { a.prepare(x0, z0, w, h, step); }
+    Lanes eval(const Lanes& x, const Lanes& z) const {
+        Lanes l = a.eval(x, z);
+        for (int i = 0; i < kLanes; i++) l.v[i] = std::min(std::max(l.v[i], lo), hi);
+        return l;
+    }
+};
+
+// Piecewise-linear remap through sorted (in, out) points, flat outside them.
+// No points means identity.
+template <class A>
+struct Spline : Node {
+    A a;
+    std::vector<std::pair<float, float>> points;
+    Spline(const A& a_, std::vector<std::pair<float, float>> points_) : a(a_), points(std::move(points_)) {}
+    void prepare(int x0, int z0, int w, int h, int step) { a.prepare(x0, z0, w, h, step); }
+    Lanes eval(const Lanes& x, const Lanes& z) const {
+        Lanes l = a.eval(x, z);
+        int n = points.size();
+        if (n == 0) return l;
+        for (int i = 0; i < kLanes; i++) {
+            float t = l.v[i];
+            float r = t <= points[0].first ? points[0].second : points[n-1].second;
+            for (int k = 1; k < n; k++) {
+                const auto& p0 = points[k-1];
+                const auto& p1 = points[k];
+                bool in = t > p0.first && t <= p1.first;
+                float s = (t - p0.first) / (p1.first - p0.first);
+                r = in ? p0.second + s * (p1.second - p0.second) : r;
+            }
+            l.v[i] = r;
+        }
+        return l;
+    }
+};
+
+// Evaluates A at (x + amount*wx(x, z), z + amount*wz(x, z)). Amount 0 skips the warp.
+template <class A, class WX, class WZ>
+struct Warp : Node {
+    A a; WX wx; WZ wz;
+    float amount;
+    Warp(const A& a_, const WX& wx_, const WZ& wz_, float amount_) : a(a_), wx(wx_), wz(wz_), amount(amount_) {}
+    void prepare(int x0, int z0, int w, int h, int step) {
+        if (amount == 0.0f) a.prepare(x0, z0, w, h, step);
+        else { wx.prepare(x0, z0, w, h, step); wz.prepare(x0, z0, w, h, step); }
+    }
+    Lanes eval(const Lanes& x, const Lanes& z) const {
+        if (amount == 0.0f) return a.eval(x, z);
+        Lanes ox = wx.eval(x, z), oz = wz.eval(x, z);
+        for (int i = 0; i < kLanes; i++) {
+            ox.v[i] = x.v[i] + amount * ox.v[i];
+            oz.v[i] = z.v[i] + amount * oz.v[i];
+        }
+        return a.eval(ox, oz);
+    }
+};
+
+template <class T> using IsNode = std::enable_if_t<std::is_base_of<Node, T>::value, int>;
+
+template <class A, class B, IsNode<A> = 0, IsNode<B> = 0>
+Add<A, B> operator+(const A& a, const B& b) { return {a, b}; }
+template <class A, IsNode<A> = 0>
+Add<A, Const> operator+(const A& a, float b) { return {a, Const(b)}; }
+template <class A, class B, IsNode<A> = 0, IsNode<B> = 0>
+Mul<A, B> operator*(const A& a, const B& b) { return {a, b}; }
+template <class A, IsNode<A> = 0>
+Mul<A, Const> operator*(const A& a, float b) { return {a, Const(b)}; }
+
+template <class A> Clamp<A> clamp(const A& a, float lo, float hi) { return {a, lo, hi}; }
+template <class A> Spline<A> spline(const A& a, std::vector<std::pair<float, float>> points) { return {a, std::move(points)}; }
+template <class A, class WX, class WZ>
+Warp<A, WX, WZ> warp(const A& a, const WX& wx, const WZ& wz, float amount) { return {a, wx, wz, amount}; }
+
+// Evaluates e at (x0 + x*step, z0 + z*step) for the row-major w×h samples of out.
+// Works on a copy of e, so one graph can be evaluated from several threads.
+template <class E>
+void evalTile(const E& graph, int x0, int z0, int w, int h, float* out, int step = 1) {
+    E e = graph;
+    e.prepare(x0, z0, w, h, step);
+    Lanes xs, zs;
+    for (int z = 0; z < h; z++) {
+        for (int i = 0; i < kLanes; i++) zs.v[i] = z0 + z*step;
+        for (int x = 0; x < w; x += kLanes) {
+            for (int i = 0; i < kLanes; i++) xs.v[i] = x0 + (x + i)*step;
+            Lanes r = e.eval(xs, zs);
+            int n = std::min(kLanes, w - x);
+            for (int i = 0; i < n; i++) out[z*w + x + i] = r.v[i];
+        }
+    }
+}
+
+// Tunable constants for a graph, read from "key = value" lines ('#' starts a comment).
+// Splines are written as "in:out in:out ...".
+struct Params {
+    std::map<std::string, std::string> values;
+
+    void load(const std::string& fname);
+    float get(const std::string& key, float def) const;
+    std::vector<std::pair<float, float>> points(const std::string& key) const;
+};
+
+}
+
+#endif
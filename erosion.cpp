@@ -0,0 +1,172 @@
+#include "erosion.h"
+#include "metrics.h"
+#include "parallel.h"
+#include <algorithm>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Divisors are clamped to the smallest positive float instead of branching on zero:
+// the numerators are 0 whenever the divisor is, so the quotients stay exact.
+static const float kTiny = std::numeric_limits<float>::denorm_min();
+
+// Outflow of one row towards lower neighbours, limited to the water in the cell.
+static void outflowRow(const float* __restrict hu, const float* __restrict hc, const float* __restrict hd,
+                       const float* __restrict wu, const float* __restrict wc, const float* __restrict wd,
+                       const float* __restrict sc, float* __restrict oL, float* __restrict oR,
+                       float* __restrict oU, float* __restrict oD, float* __restrict fr, int n, float flow) {
+    int x = 1;
+#ifdef __SSE2__
+    // Four cells at a time, in the same operation order as the scalar loop below;
+    // maxps/minps pick the same operand as std::max/std::min for non-NaN inputs.
+    const __m128 zero = _mm_setzero_ps(), tiny = _mm_set1_ps(kTiny);
+    const __m128 vflow = _mm_set1_ps(flow), quarter = _mm_set1_ps(0.25f);
+    for (; x + 4 <= n - 1; x += 4) {
+        __m128 wi = _mm_loadu_ps(wc + x);
+        __m128 H = _mm_add_ps(_mm_loadu_ps(hc + x), wi);
+        __m128 dl = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(H, _mm_loadu_ps(hc + x - 1)), _mm_loadu_ps(wc + x - 1)), zero);
+        __m128 dr = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(H, _mm_loadu_ps(hc + x + 1)), _mm_loadu_ps(wc + x + 1)), zero);
+        __m128 du = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(H, _mm_loadu_ps(hu + x)), _mm_loadu_ps(wu + x)), zero);
+        __m128 dd = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(H, _mm_loadu_ps(hd + x)), _mm_loadu_ps(wd + x)), zero);
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(dl, dr), du), dd);
+        __m128 f = _mm_min_ps(_mm_mul_ps(_mm_mul_ps(vflow, sum), quarter), wi);
+        __m128 k = _mm_div_ps(f, _mm_max_ps(sum, tiny));
+        _mm_storeu_ps(oL + x, _mm_mul_ps(dl, k));
+        _mm_storeu_ps(oR + x, _mm_mul_ps(dr, k));
+        _mm_storeu_ps(oU + x, _mm_mul_ps(du, k));
+        _mm_storeu_ps(oD + x, _mm_mul_ps(dd, k));
+        __m128 q = _mm_div_ps(_mm_loadu_ps(sc + x), _mm_max_ps(wi, tiny));
+        _mm_storeu_ps(fr + x, _mm_and_ps(q, _mm_cmpgt_ps(wi, zero)));
+    }
+#endif
+    for (; x < n - 1; x++) {
+        float wi = wc[x];
+        float H = hc[x] + wi;
+        float dl = std::max(0.0f, H - hc[x-1] - wc[x-1]);
+        float dr = std::max(0.0f, H - hc[x+1] - wc[x+1]);
+        float du = std::max(0.0f, H - hu[x] - wu[x]);
+        float dd = std::max(0.0f, H - hd[x] - wd[x]);
+        float sum = dl + dr + du + dd;
+        float f = std::min(wi, flow * sum * 0.25f);
+        float k = f / std::max(sum, kTiny);
+        oL[x] = dl * k; oR[x] = dr * k; oU[x] = du * k; oD[x] = dd * k;
+        float q = sc[x] / std::max(wi, kTiny);
+        fr[x] = wi > 0.0f ? q : 0.0f;
+    }
+}
+
+// Moves water and sediment into one row, then erodes or deposits towards capacity.
+static void moveRow(const float* __restrict oL, const float* __restrict oR, const float* __restrict oUd,
+                    const float* __restrict oU, const float* __restrict oDu, const float* __restrict oD,
+                    const float* __restrict fu, const float* __restrict fc, const float* __restrict fd,
+                    float* __restrict hc, float* __restrict wc, float* __restrict sc, int n, const ErosionParams& p) {
+    const float capacity = p.capacity, deposition = p.deposition, erosion = p.erosion;
+    const float max_erosion = p.max_erosion, keep = 1.0f - p.evaporation;
+    int x = 1;
+#ifdef __SSE2__
+    const __m128 zero = _mm_setzero_ps(), vcap = _mm_set1_ps(capacity), vdep = _mm_set1_ps(deposition);
+    const __m128 vero = _mm_set1_ps(erosion), vmax = _mm_set1_ps(max_erosion), vkeep = _mm_set1_ps(keep);
+    for (; x + 4 <= n - 1; x += 4) {
+        __m128 rl = _mm_loadu_ps(oR + x - 1), lr = _mm_loadu_ps(oL + x + 1);
+        __m128 du = _mm_loadu_ps(oDu + x), ud = _mm_loadu_ps(oUd + x), fx = _mm_loadu_ps(fc + x);
+        __m128 out_w = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_loadu_ps(oL + x), _mm_loadu_ps(oR + x)),
+                                             _mm_loadu_ps(oU + x)), _mm_loadu_ps(oD + x));
+        __m128 in_w = _mm_add_ps(_mm_add_ps(_mm_add_ps(rl, lr), du), ud);
+        __m128 in_s = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rl, _mm_loadu_ps(fc + x - 1)),
+                                                       _mm_mul_ps(lr, _mm_loadu_ps(fc + x + 1))),
+                                            _mm_mul_ps(du, _mm_loadu_ps(fu + x))),
+                                 _mm_mul_ps(ud, _mm_loadu_ps(fd + x)));
+        __m128 s = _mm_add_ps(_mm_sub_ps(_mm_loadu_ps(sc + x), _mm_mul_ps(out_w, fx)), in_s);
+        __m128 cap = _mm_mul_ps(vcap, out_w);
+        __m128 dep = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(s, cap), zero), vdep);
+        __m128 ero = _mm_min_ps(_mm_mul_ps(_mm_max_ps(_mm_sub_ps(cap, s), zero), vero), vmax);
+        _mm_storeu_ps(hc + x, _mm_add_ps(_mm_loadu_ps(hc + x), _mm_sub_ps(dep, ero)));
+        _mm_storeu_ps(sc + x, _mm_add_ps(_mm_sub_ps(s, dep), ero));
+        _mm_storeu_ps(wc + x, _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_loadu_ps(wc + x), out_w), in_w), vkeep));
+    }
+#endif
+    for (; x < n - 1; x++) {
+        float out_w = oL[x] + oR[x] + oU[x] + oD[x];
+        float in_w = oR[x-1] + oL[x+1] + oDu[x] + oUd[x];
+        float in_s = oR[x-1]*fc[x-1] + oL[x+1]*fc[x+1] + oDu[x]*fu[x] + oUd[x]*fd[x];
+        float s = sc[x] - out_w*fc[x] + in_s;
+        float cap = capacity * out_w;
+        float dep = std::max(0.0f, s - cap) * deposition;
+        float ero = std::min(std::max(0.0f, cap - s) * erosion, max_erosion);
+        hc[x] += dep - ero;
+        sc[x] = s - dep + ero;
+        wc[x] = (wc[x] - out_w + in_w) * keep;
+    }
+}
+
+// Erodes the tile at (tx0, tz0) of the band starting at row tz0. row(z) is input row z,
+// clamped by the caller's window to [0, h).
+static void erodeTile(const std::function<const float*(int)>& row, float* out, int w, int h,
+                      int tx0, int tz0, const ErosionParams& p) {
+    const int n = p.tile + 2*p.halo;
+    const size_t nn = (size_t)n * n;
+    const int x0 = tx0 - p.halo, z0 = tz0 - p.halo;
+    std::vector<float> hgt(nn), water(nn, 0.0f), sed(nn, 0.0f), frac(nn, 0.0f);
+    std::vector<float> outL(nn, 0.0f), outR(nn, 0.0f), outU(nn, 0.0f), outD(nn, 0.0f);
+    for (int z = 0; z < n; z++) {
+        const float* src = row(std::min(std::max(z0 + z, 0), h - 1));
+        for (int x = 0; x < n; x++) {
+            int sx = std::min(std::max(x0 + x, 0), w - 1);
+            hgt[(size_t)z*n + x] = src[sx] * p.vertical;
+        }
+    }
+
+    for (int it = 0; it < p.iterations; it++) {
+        for (size_t i = 0; i < nn; i++) water[i] += p.rain;
+        for (int z = 1; z < n - 1; z++) {
+            size_t i = (size_t)z * n;
+            outflowRow(&hgt[i-n], &hgt[i], &hgt[i+n], &water[i-n], &water[i], &water[i+n], &sed[i],
+                       &outL[i], &outR[i], &outU[i], &outD[i], &frac[i], n, p.flow);
+        }
+        for (int z = 1; z < n - 1; z++) {
+            size_t i = (size_t)z * n;
+            moveRow(&outL[i], &outR[i], &outU[i+n], &outU[i], &outD[i-n], &outD[i],
+                    &frac[i-n], &frac[i], &frac[i+n], &hgt[i], &water[i], &sed[i], n, p);
+        }
+    }
+
+    // Sediment still suspended when the rain stops settles where it is.
+    for (int z = 0; z < p.tile && tz0 + z < h; z++) {
+        for (int x = 0; x < p.tile && tx0 + x < w; x++) {
+            size_t i = (size_t)(z + p.halo)*n + x + p.halo;
+            out[(size_t)z*w + tx0 + x] = (hgt[i] + sed[i]) / p.vertical;
+        }
+    }
+}
+
+ErosionStream::ErosionStream(int w_, int h_, const ErosionParams& p_, int threads_, Source source_)
+    : w(w_), h(h_), threads(threads_), p(p_), source(std::move(source_)) {
+    p.tile = std::max(16, (p.tile + 15) / 16 * 16);
+    p.halo = std::max(1, p.halo);
+}
+
+const float* ErosionStream::rows(int cz) {
+    int z = cz * 16;
+    if (band_z0 < 0 || z >= band_z0 + p.tile) erodeBand(z / p.tile * p.tile);
+    return &band[(size_t)(z - band_z0) * w];
+}
+
+void ErosionStream::erodeBand(int z0) {
+    const int lo = std::max(0, z0 - p.halo), hi = std::min(h, z0 + p.tile + p.halo);
+    // Keep only the strips this band's window overlaps, then fetch the missing ones.
+    while (!strips.empty() && (strips.begin()->first + 1) * 16 <= lo) strips.erase(strips.begin());
+    for (int cz = lo / 16; cz * 16 < hi; cz++) {
+        auto& s = strips[cz];
+        if (s.empty()) {
+            s.resize((size_t)16 * w);
+            source(cz, s.data());
+        }
+    }
+    metrics::Scope m(metrics::erosion, (uint64_t)std::min(p.tile, h - z0) * w);
+    auto row = [&](int z) -> const float* { return &strips.at(z / 16)[(size_t)(z % 16) * w]; };
+    band.assign((size_t)p.tile * w, 0.0f);
+    const int tw = (w + p.tile - 1) / p.tile;
+    parallelFor(tw, threads, [&](int t, int) { erodeTile(row, band.data(), w, h, t * p.tile, z0, p); });
+    band_z0 = z0;
+}
@@ -0,0 +1,51 @@
+#ifndef EROSION_H
+#define EROSION_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <vector>
+
+// Grid-based hydraulic erosion: every iteration rains on each cell, moves water and
+// suspended sediment to lower 4-neighbours in proportion to the height drop, and
+// erodes or deposits towards a capacity set by the outflow. Both passes are gathers
+// over contiguous rows of floats, four cells at a time with SSE2.
+struct ErosionParams {
+    int iterations = 100;
+    int tile = 256;           // interior tile size in cells, rounded up to whole chunk rows
+    int halo = 96;            // extra cells around each tile that are simulated but not written back
+    float vertical = 32.0f;   // heightfield units to blocks
+    float rain = 0.005f;      // water added per cell per iteration, blocks
+    float evaporation = 0.02f;
+    float flow = 0.5f;        // fraction of the height drop that flows per iteration
+    float capacity = 256.0f;  // sediment capacity per unit of outflow
+    float erosion = 0.05f;
+    float deposition = 0.05f;
+    float max_erosion = 0.05f; // per cell per iteration, blocks
+};
+
+// Erodes a w×h heightfield one band of tile rows at a time, pulling 16-row strips
+// from `source` as the band and its halo need them, so only about
+// (tile + 2·halo)·w floats are held instead of the whole field. Tiles are eroded
+// independently from the uneroded input plus their halo and only their interior is
+// kept, so the result is deterministic and does not depend on the thread count.
+struct ErosionStream {
+    using Source = std::function<void(int cz, float* out)>; // the 16 rows of chunk row cz
+
+    ErosionStream(int w, int h, const ErosionParams& p, int threads, Source source);
+    // The eroded rows of chunk row cz, w floats each. Rows are requested in increasing
+    // order (gaps are fine); the pointer is valid until the next call.
+    const float* rows(int cz);
+
+  private:
+    void erodeBand(int z0);
+
+    int w, h, threads;
+    ErosionParams p;
+    Source source;
+    std::map<int, std::vector<float>> strips; // uneroded input by chunk row
+    std::vector<float> band;                  // eroded rows [band_z0, band_z0 + tile)
+    int band_z0 = -1;
+};
+
+#endif
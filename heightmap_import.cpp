@@ -0,0 +1,166 @@
+#include "heightmap_import.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static const char kTiledMagic[4] = {'M', 'H', 'T', '1'};
+static const int kTile = 256;
+
+static uint32_t be32(const uint8_t* p) { return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+
+// Streams a 16-bit grayscale PNG into the tiled raw format, holding one row of tiles.
+static void convertPng(const std::string& path, const std::string& out_path) {
+    std::ifstream in(path, std::ios::binary);
+    uint8_t sig[8];
+    if (!in.read((char*)sig, 8) || memcmp(sig, "\x89PNG\r\n\x1a\n", 8) != 0) {
+        std::cerr << "Not a PNG: " << path << "\n"; exit(1);
+    }
+    uint32_t w = 0, h = 0;
+    z_stream zs = {};
+    inflateInit(&zs);
+    std::vector<uint8_t> chunk, prev, row, band;
+    size_t stride = 0, have = 0;
+    uint32_t y = 0;
+    std::ofstream out(out_path + ".tmp", std::ios::binary);
+    auto flush_band = [&](uint32_t rows) {
+        // band holds `rows` image rows of samples; write its tiles padded to kTile.
+        std::vector<uint16_t> t(kTile * kTile);
+        for (uint32_t tx = 0; tx < (w + kTile - 1) / kTile; tx++) {
+            std::fill(t.begin(), t.end(), 0);
+            for (uint32_t r = 0; r < rows; r++)
+                for (uint32_t c = 0; c < kTile && tx*kTile + c < w; c++) {
+                    const uint8_t* s = &band[(r*w + tx*kTile + c) * 2];
+                    t[r*kTile + c] = s[0] << 8 | s[1]; // PNG samples are big-endian
+                }
+            out.write((const char*)t.data(), t.size() * 2);
+        }
+    };
+    for (;;) {
+        uint8_t head[8];
+        if (!in.read((char*)head, 8)) { std::cerr << "Truncated PNG " << path << "\n"; exit(1); }
+        uint32_t n = be32(head);
+        chunk.resize(n + 4);
+        in.read((char*)chunk.data(), n + 4);
+        if (memcmp(head + 4, "IHDR", 4) == 0) {
+            w = be32(&chunk[0]); h = be32(&chunk[4]);
+            if (chunk[8] != 16 || chunk[9] != 0 || chunk[12] != 0) {
+                std::cerr << "Only non-interlaced 16-bit grayscale PNGs can be imported: " << path << "\n"; exit(1);
+            }
+            stride = (size_t)w * 2;
+            prev.assign(stride, 0);
+            row.resize(stride + 1);
+            band.resize(stride * kTile);
+            uint32_t header[3] = {w, h, (uint32_t)kTile};
+            out.write(kTiledMagic, 4);
+            out.write((const char*)header, sizeof(header));
+        } else if (memcmp(head + 4, "IDAT", 4) == 0) {
+            zs.next_in = chunk.data();
+            zs.avail_in = n;
+            while (zs.avail_in > 0 && y < h) {
+                zs.next_out = row.data() + have;
+                zs.avail_out = row.size() - have;
+                int ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END) { std::cerr << "Corrupt PNG data in " << path << "\n"; exit(1); }
+                have = row.size() - zs.avail_out;
+                if (have < row.size()) continue;
+                // Undo the row filter (2 bytes per pixel) against the previous row.
+                uint8_t* cur = row.data() + 1;
+                for (size_t i = 0; i < stride; i++) {
+                    int a = i >= 2 ? cur[i - 2] : 0, b = prev[i], c = i >= 2 ? prev[i - 2] : 0, p = a + b - c;
+                    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    switch (row[0]) {
+                        case 1: cur[i] += a; break;
+                        case 2: cur[i] += b; break;
+                        case 3: cur[i] += (a + b) / 2; break;
+                        case 4: cur[i] += pa <= pb && pa <= pc ? a : pb <= pc ? b : c; break;
+                    }
+                }
+                std::copy(cur, cur + stride, prev.begin());
+                std::copy(cur, cur + stride, band.begin() + (y % kTile) * stride);
+                have = 0;
+                if (++y % kTile == 0 || y == h) flush_band((y - 1) % kTile + 1);
+            }
+        } else if (memcmp(head + 4, "IEND", 4) == 0) {
+            break;
+        }
+    }
+    inflateEnd(&zs);
+    if (y != h) { std::cerr << "PNG " << path << " ended after " << y << " of " << h << " rows\n"; exit(1); }
+    out.close();
+    std::filesystem::rename(out_path + ".tmp", out_path);
+}
+
+void ImportedHeights::open(const std::string& path, int raw_width, int raw_height) {
+    std::string map_path = path;
+    std::ifstream probe(path, std::ios::binary);
+    char magic[8] = {};
+    probe.read(magic, 8);
+    if (memcmp(magic, "\x89PNG", 4) == 0) {
+        map_path = path + ".tiles";
+        namespace fs = std::filesystem;
+        if (!fs::exists(map_path) || fs::last_write_time(map_path) < fs::last_write_time(path)) convertPng(path, map_path);
+    }
+
+    int fd = ::open(map_path.c_str(), O_RDONLY);
+    if (fd < 0) { std::cerr << "Cannot open " << map_path << "\n"; exit(1); }
+    size = lseek(fd, 0, SEEK_END);
+    void* p = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (p == MAP_FAILED) { std::cerr << "Cannot map " << map_path << "\n"; exit(1); }
+    base = (uint8_t*)p;
+
+    if (size >= 16 && memcmp(base, kTiledMagic, 4) == 0) {
+        const uint32_t* header = (const uint32_t*)(base + 4);
+        width = header[0]; height = header[1]; tile = header[2];
+        tiles_x = (width + tile - 1) / tile;
+        size_t tiles_z = (height + tile - 1) / tile;
+        if (size < 16 + tiles_x * tiles_z * tile * tile * 2) { std::cerr << "Truncated tiled heightmap " << map_path << "\n"; exit(1); }
+        data = (const uint16_t*)(base + 16);
+    } else {
+        width = raw_width;
+        height = raw_height;
+        if (!width) width = height = (int)std::lround(std::sqrt(size / 2.0));
+        if ((size_t)width * height * 2 != size) {
+            std::cerr << "Raw heightmap " << map_path << " is not " << width << "x" << height << " 16-bit samples\n"; exit(1);
+        }
+        tile = 0;
+        data = (const uint16_t*)base;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+}
+
+ImportedHeights::~ImportedHeights() {
+    if (base) munmap(base, size);
+}
+
+uint16_t ImportedHeights::at(int x, int z) const {
+    x = std::min(std::max(x, 0), width - 1);
+    z = std::min(std::max(z, 0), height - 1);
+    if (!tile) return data[(size_t)z*width + x];
+    return data[(((size_t)(z / tile)*tiles_x + x / tile)*tile + z % tile)*tile + x % tile];
+}
+
+void ImportedHeights::sample(int x0, int z0, int w, int h, int step, float* out) const {
+    const float inv = 1.0f / scale, norm = 1.0f / (hi - lo);
+    for (int j = 0; j < h; j++) {
+        float v = (z0 + j*step) * inv;
+        int sz = (int)std::floor(v);
+        float tz = v - sz;
+        for (int i = 0; i < w; i++) {
+            float u = (x0 + i*step) * inv;
+            int sx = (int)std::floor(u);
+            float tx = u - sx;
+            float a = at(sx, sz) + tx * (at(sx + 1, sz) - at(sx, sz));
+            float b = at(sx, sz + 1) + tx * (at(sx + 1, sz + 1) - at(sx, sz + 1));
+            out[j*w + i] = (a + tz * (b - a) - lo) * norm;
+        }
+    }
+}
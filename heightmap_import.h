@@ -0,0 +1,42 @@
+#ifndef HEIGHTMAP_IMPORT_H
+#define HEIGHTMAP_IMPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A 16-bit elevation grid used as the height source instead of noise. Raw files
+// (little-endian, row-major) and tiled raw files are memory-mapped, so only the pages
+// under the rows being generated are resident. 16-bit grayscale PNGs are decoded once,
+// a row at a time, into a tiled raw file next to them (<file>.tiles) that later runs
+// map directly.
+//
+// Tiled raw: "MHT1", then uint32 width, height and tile size, then the tiles in
+// row-major order, each tile×tile little-endian samples with edge tiles padded.
+struct ImportedHeights {
+    int width = 0, height = 0; // samples
+    int tile = 0;              // 0 = plain row-major raw
+    float scale = 1.0f;        // blocks per sample
+    float lo = 0.0f, hi = 65535.0f; // sample values for normalized heights 0 and 1
+
+    ImportedHeights() = default;
+    ImportedHeights(const ImportedHeights&) = delete;
+    ~ImportedHeights();
+
+    // raw_width/raw_height size a plain raw file; 0 assumes a square one.
+    void open(const std::string& path, int raw_width = 0, int raw_height = 0);
+    bool enabled() const { return data != nullptr; }
+    int blocksX() const { return (int)(width * scale); }
+    int blocksZ() const { return (int)(height * scale); }
+
+    uint16_t at(int x, int z) const; // clamped to the grid
+    // Normalized heights at blocks (x0 + i*step, z0 + j*step), bilinear between samples.
+    void sample(int x0, int z0, int w, int h, int step, float* out) const;
+
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    const uint16_t* data = nullptr;
+    int tiles_x = 0;
+};
+
+#endif
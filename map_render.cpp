@@ -0,0 +1,72 @@
+#include "map_render.h"
+#include "parallel.h"
+#include <algorithm>
+
+MapColors MapColors::defaults() {
+    MapColors c;
+    c.set("stone", {125, 125, 125});
+    c.set("cobblestone", {122, 122, 122});
+    c.set("deepslate", {80, 80, 85});
+    c.set("bedrock", {50, 50, 50});
+    c.set("dirt", {134, 96, 67});
+    c.set("grass_block", {95, 159, 53});
+    c.set("sand", {219, 207, 163});
+    c.set("gravel", {136, 126, 125});
+    c.set("clay", {160, 166, 179});
+    c.set("water", {52, 90, 200});
+    c.set("lava", {207, 92, 20});
+    c.set("ice", {145, 183, 253});
+    c.set("snow_block", {249, 254, 254});
+    c.set("oak_log", {102, 81, 51});
+    c.set("oak_leaves", {60, 120, 40});
+    c.set("oak_planks", {162, 130, 78});
+    c.set("glass", {200, 220, 230});
+    return c;
+}
+
+void MapColors::set(const std::string& block, Rgb color) {
+    auto b = block::find(block);
+    if (!b) { std::cerr << "Unknown block " << block << " in map colors\n"; exit(1); }
+    colors[b.get()] = color;
+}
+
+Rgb MapColors::shade(const Block* b, int top, int north_top, int water_depth) const {
+    auto it = colors.find(b);
+    const Rgb& base = it == colors.end() ? unknown : it->second;
+    float f = b == block::water.get() ? 1.0f - std::min(water_depth, 16) * 0.03f
+                                      : 1.0f + std::max(-0.25f, std::min(0.25f, (top - north_top) * 0.08f));
+    Rgb c;
+    for (int i = 0; i < 3; i++) c[i] = (uint8_t)std::min(255.0f, base[i] * f);
+    return c;
+}
+
+void renderMap(const World& world, int cx0, int cz0, int w, int h, const MapColors& colors, uint8_t* rgb, int threads,
+               const int16_t* north_edge) {
+    const size_t stride = (size_t)w * 16 * 3;
+    parallelFor(w * h, threads, [&](int i, int) {
+        int cx = cx0 + i % w, cz = cz0 + i / w;
+        uint8_t* out = rgb + (size_t)(i / w) * 16 * stride + (i % w) * 16 * 3;
+        const Chunk* chunk = world.find(cx, cz);
+        const Chunk* north = world.find(cx, cz - 1);
+        const int16_t* edge = north ? &north->heightmap[15*16] : north_edge && i < w ? north_edge + i*16 : nullptr;
+        if (edge && edge[0] == INT16_MIN) edge = nullptr;
+        for (int z = 0; z < 16; z++) {
+            for (int x = 0; x < 16; x++) {
+                uint8_t* px = out + z*stride + x*3;
+                int top = chunk ? chunk->heightmap[z*16 + x] - 1 : -1;
+                const Block* b = top >= 0 ? chunk->blockAt(x, top, z) : nullptr;
+                if (!b) { std::copy(colors.empty.begin(), colors.empty.end(), px); continue; }
+                int depth = 0, north_top = top;
+                if (b == block::water.get()) {
+                    int y = top;
+                    while (y > 0 && chunk->blockAt(x, y - 1, z) == b) y--;
+                    depth = top - y;
+                } else {
+                    north_top = (z > 0 ? chunk->heightmap[(z - 1)*16 + x] : edge ? edge[x] : top + 1) - 1;
+                }
+                Rgb c = colors.shade(b, top, north_top, depth);
+                std::copy(c.begin(), c.end(), px);
+            }
+        }
+    });
+}
@@ -0,0 +1,33 @@
+#ifndef MAP_RENDER_H
+#define MAP_RENDER_H
+
+#include "mca_generator.h"
+#include <array>
+#include <string>
+#include <unordered_map>
+
+using Rgb = std::array<uint8_t, 3>;
+
+// Top-down map colour per block, looked up by the registry's Block pointers.
+struct MapColors {
+    std::unordered_map<const Block*, Rgb> colors;
+    Rgb unknown = {255, 0, 255};
+    Rgb empty = {0, 0, 0};  // missing chunks and all-air columns
+
+    static MapColors defaults();
+    void set(const std::string& block, Rgb color);
+    // Colour of top block b at y = top: land is lit by the step up from the column to
+    // the north (north_top), water darkens with its depth.
+    Rgb shade(const Block* b, int top, int north_top, int water_depth) const;
+};
+
+// Colours the top block of every column of chunks [cx0, cx0 + w) × [cz0, cz0 + h) into
+// rgb (row-major, 16 pixels per chunk), one chunk per task. The top comes from the
+// chunk heightmaps recorded during generation; terrain is shaded by the height step to
+// the north and water darkens with depth. Only reads the world. north_edge, if given,
+// is the last heightmap row of chunk row cz0 - 1 (16 per chunk from cx0, INT16_MIN where
+// missing), for when those chunks have already been written out.
+void renderMap(const World& world, int cx0, int cz0, int w, int h, const MapColors& colors, uint8_t* rgb, int threads,
+               const int16_t* north_edge = nullptr);
+
+#endif
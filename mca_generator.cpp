@@ -1,11 +1,31 @@
 #include "mca_generator.h"
+#include "metrics.h"
 #include <cmath>
 #include <cstring>
 #include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace block {
     const std::string ns = "minecraft";
-#define DEFINE_BLOCK(name, id) std::shared_ptr<const Block> name = std::make_shared<const Block>(ns, id);
+
+    static std::vector<std::shared_ptr<const Block>>& registry() {
+        static std::vector<std::shared_ptr<const Block>> blocks;
+        return blocks;
+    }
+
+    static std::shared_ptr<const Block> define(const std::string& ns_, const std::string& id) {
+        registry().push_back(std::make_shared<const Block>(ns_, id));
+        return registry().back();
+    }
+
+    std::shared_ptr<const Block> find(const std::string& name) {
+        for (const auto& b : registry()) if (b->id == name || b->name() == name) return b;
+        return nullptr;
+    }
+
+#define DEFINE_BLOCK(name, id) std::shared_ptr<const Block> name = define(ns, id);
     DEFINE_BLOCK(stone, "stone")
     DEFINE_BLOCK(dirt, "dirt")
     DEFINE_BLOCK(grass_block, "grass_block")
@@ -85,10 +105,21 @@ namespace block {
     DEFINE_BLOCK(raw_gold_block, "raw_gold_block")
     DEFINE_BLOCK(raw_copper_block, "raw_copper_block")
 #undef DEFINE_BLOCK
-}// Section implementation
+}// Accounted sizes; each section owns its air block.
+static const int64_t kSectionBytes = sizeof(Section) + sizeof(Block);
+static const int64_t kChunkBiomeBytes = 1024 * sizeof(int);
+static const int64_t kRegionBiomeBytes = 128 * (sizeof(std::vector<int>) + 128 * sizeof(int));
+
+// Section implementation
 Section::Section(int y_) : y(y_) {
     blocks.fill(nullptr);
     air = new Block("minecraft", "air");
+    memory::add(memory::sections, kSectionBytes, 1);
+}
+
+Section::~Section() {
+    delete air;
+    memory::add(memory::sections, -kSectionBytes, -1);
 }
 
 void Section::setBlock(Block* block, int x, int yy, int z) {
@@ -141,10 +172,157 @@ std::vector<uint64_t> Section::blockStates(const std::vector<Block*>& pal) const
     return states;
 }
 
+// ChunkTile implementation
+ChunkTile::ChunkTile() {
+    clear();
+}
+
+void ChunkTile::clear() {
+    palette.assign(1, nullptr);
+    cells.fill(0);
+    topY = -1;
+}
+
+uint8_t ChunkTile::id(const Block* block) {
+    auto it = std::find(palette.begin(), palette.end(), block);
+    if (it != palette.end()) return it - palette.begin();
+    if (palette.size() == 256) { std::cerr << "ChunkTile palette full\n"; exit(1); }
+    palette.push_back(block);
+    return palette.size() - 1;
+}
+
+void ChunkTile::fill(int x, int z, int y0, int y1, uint8_t b) {
+    y0 = std::max(y0, 0);
+    y1 = std::min(y1, 255);
+    if (y0 > y1) return;
+    std::memset(column(x, z) + y0, b, y1 - y0 + 1);
+    if (b && y1 > topY) topY = y1;
+}
+
+void ChunkTile::setColumn(int x, int z, const Run* runs, int n) {
+    int y = 0;
+    for (int i = 0; i < n; i++) {
+        fill(x, z, y, runs[i].top, id(runs[i].block));
+        y = std::max(y, runs[i].top + 1);
+    }
+}
+
+// Transposes a 16×16 byte block: row i of src (stride srcStride) becomes column i of dst.
+static void transpose16(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride) {
+#ifdef __SSE2__
+    // Interleaving row i with row i+8 rotates the 8-bit (row, col) index left by one;
+    // four rounds swap row and column.
+    __m128i r[16], t[16];
+    for (int i = 0; i < 16; i++) r[i] = _mm_loadu_si128((const __m128i*)(src + i*srcStride));
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < 8; i++) {
+            t[2*i]   = _mm_unpacklo_epi8(r[i], r[i+8]);
+            t[2*i+1] = _mm_unpackhi_epi8(r[i], r[i+8]);
+        }
+        std::copy(t, t + 16, r);
+    }
+    for (int i = 0; i < 16; i++) _mm_storeu_si128((__m128i*)(dst + i*dstStride), r[i]);
+#else
+    for (int i = 0; i < 16; i++)
+        for (int j = 0; j < 16; j++) dst[j*dstStride + i] = src[i*srcStride + j];
+#endif
+}
+
+void ChunkTile::store(std::array<Section*, 16>& out) const {
+    Block* pal[256] = {};
+    for (size_t i = 1; i < palette.size(); i++) pal[i] = const_cast<Block*>(palette[i]);
+    alignas(16) uint8_t slab[4096];
+    for (int secY = 0; secY <= topY / 16; secY++) {
+        bool empty = true;
+        for (int z = 0; z < 16; z++) {
+            transpose16(&cells[(z*16)*256 + secY*16], 256, slab + z*16, 256);
+        }
+        for (int i = 0; i < 4096 && empty; i++) empty = slab[i] == 0;
+        if (empty && !out[secY]) continue;
+        if (!out[secY]) out[secY] = new Section(secY);
+        Block** dst = out[secY]->blocks.data();
+        for (int i = 0; i < 4096; i += 16) {
+            const uint8_t* row = slab + i;
+            if (std::memcmp(row, row + 1, 15) == 0) std::fill(dst + i, dst + i + 16, pal[row[0]]);
+            else for (int j = 0; j < 16; j++) dst[i + j] = pal[row[j]];
+        }
+    }
+}
+
+// ColumnChunk implementation
+ColumnChunk::ColumnChunk() {
+    palette.push_back(nullptr);
+    start.fill(0);
+    count.fill(0);
+}
+
+void ColumnChunk::setColumn(int x, int z, const Run* r, int n) {
+    if (x<0||x>15||z<0||z>15) {
+        std::cerr << "ColumnChunk setColumn out of bounds\n"; exit(1);
+    }
+    ColumnRun tmp[256];
+    int len = 0, prevTop = -1;
+    for (int i = 0; i < n; i++) {
+        int top = std::min(r[i].top, 255);
+        if (top <= prevTop) continue; // empty run
+        auto it = std::find(palette.begin(), palette.end(), r[i].block);
+        if (it == palette.end()) {
+            if (palette.size() == 256) { std::cerr << "ColumnChunk palette full\n"; exit(1); }
+            it = palette.insert(palette.end(), r[i].block);
+        }
+        uint8_t b = it - palette.begin();
+        if (len > 0 && tmp[len-1].block == b) tmp[len-1].top = top; // merge equal neighbours
+        else tmp[len++] = {b, (uint8_t)top};
+        prevTop = top;
+    }
+    int col = z*16 + x;
+    if (len > count[col]) { // does not fit in the old slot, append
+        start[col] = runs.size();
+        runs.resize(runs.size() + len);
+    }
+    std::copy(tmp, tmp + len, runs.begin() + start[col]);
+    count[col] = len;
+}
+
+void ColumnChunk::materialize(std::array<Section*, 16>& out) const {
+    static thread_local ChunkTile tile;
+    tile.clear();
+    for (size_t i = 1; i < palette.size(); i++) tile.id(palette[i]);
+    for (int col = 0; col < 256; col++) {
+        int y = 0;
+        for (int i = 0; i < count[col]; i++) {
+            const ColumnRun& r = runs[start[col] + i];
+            tile.fill(col % 16, col / 16, y, r.top, r.block);
+            y = r.top + 1;
+        }
+    }
+    tile.store(out);
+}
+
+size_t ColumnChunk::bytes() const {
+    return sizeof(*this) + palette.capacity()*sizeof(const Block*) + runs.capacity()*sizeof(ColumnRun);
+}
+
+const char* statusName(ChunkStatus status) {
+    static const char* names[] = {"empty", "noise", "surface", "carvers", "features", "light", "heightmaps", "full"};
+    return names[(int)status];
+}
+
 // Chunk implementation
 Chunk::Chunk(int cx_, int cz_) : cx(cx_), cz(cz_) {
     sections.fill(nullptr);
+    heightmap.fill(0);
     biomes.resize(1024, 1); // Initialize with plains (ID 1)
+    memory::add(memory::chunks, sizeof(Chunk), 1);
+    memory::add(memory::biomes, kChunkBiomeBytes, 1);
+}
+
+Chunk::~Chunk() {
+    for (Section* s : sections) delete s;
+    if (columns) memory::add(memory::chunks, -(int64_t)columns->bytes());
+    delete columns;
+    memory::add(memory::chunks, -(int64_t)sizeof(Chunk), -1);
+    memory::add(memory::biomes, -kChunkBiomeBytes, -1);
 }
 
 void Chunk::setBlock(Block* block, int x, int y, int z) {
@@ -158,6 +336,63 @@ void Chunk::setBlock(Block* block, int x, int y, int z) {
     sections[secY]->setBlock(block, x, y - secY*16, z);
 }
 
+void Chunk::setColumn(int x, int z, const Run* runs, int n) {
+    if (!columns) {
+        columns = new ColumnChunk();
+        memory::add(memory::chunks, columns->bytes());
+    }
+    int64_t before = columns->bytes();
+    columns->setColumn(x, z, runs, n);
+    memory::add(memory::chunks, columns->bytes() - before);
+}
+
+void Chunk::commit(const ChunkTile& tile) {
+    tile.store(sections);
+}
+
+// Sets all biomes from 4×4 quart cells (quart[qz*4 + qx]) for the full height, in the
+// same layout and overwrite order as setBiomeColumn over every column of the chunk.
+void Chunk::setBiomes(const int* quart) {
+    for (int qz = 0; qz < 4; qz++) {
+        for (int qx = 0; qx < 4; qx++) {
+            auto first = biomes.begin() + qz*64 + qx*16;
+            std::fill(first, first + 64, quart[qz*4 + qx]);
+        }
+    }
+}
+
+void Chunk::computeHeightmap() {
+    for (int col = 0; col < 256; col++) {
+        int top = 0;
+        if (columns) {
+            for (int i = 0; i < columns->count[col]; i++) {
+                const ColumnRun& r = columns->runs[columns->start[col] + i];
+                if (columns->palette[r.block]) top = r.top + 1;
+            }
+        }
+        for (int secY = 15; secY >= 0 && top <= secY*16 + 15; secY--) {
+            if (!sections[secY]) continue;
+            int y = 15;
+            while (y >= 0 && !sections[secY]->blocks[y*256 + col]) y--;
+            if (y >= 0) { top = secY*16 + y + 1; break; }
+        }
+        heightmap[col] = top;
+    }
+}
+
+const Block* Chunk::blockAt(int x, int y, int z) const {
+    if (const Section* s = sections[y >> 4]) {
+        if (const Block* b = s->blocks[(y & 15)*256 + z*16 + x]) return b;
+    }
+    if (!columns) return nullptr;
+    int col = z*16 + x;
+    for (int i = 0; i < columns->count[col]; i++) {
+        const ColumnRun& r = columns->runs[columns->start[col] + i];
+        if (y <= r.top) return columns->palette[r.block];
+    }
+    return nullptr;
+}
+
 std::vector<uint8_t> Chunk::toNBT() const {
     std::vector<uint8_t> data;
     auto put_u8 = [&](uint8_t v){ data.push_back(v); };
@@ -177,10 +412,27 @@ std::vector<uint8_t> Chunk::toNBT() const {
     put_u8(4); put_str("LastUpdate"); put_u64(0);
     put_u8(4); put_str("InhabitedTime"); put_u64(0);
     put_u8(1); put_str("isLightOn"); put_u8(1);
-    put_u8(8); put_str("Status"); put_str("full");
+    put_u8(8); put_str("Status"); put_str(statusName(status));
+
+    // Column runs are expanded into temporary sections here, one chunk at a time.
+    // Explicitly set blocks are laid over them.
+    std::array<Section*, 16> secs = sections;
+    std::array<Section*, 16> owned;
+    owned.fill(nullptr);
+    if (columns) {
+        columns->materialize(owned);
+        for (int i = 0; i < 16; i++) {
+            if (!owned[i]) continue;
+            if (sections[i]) {
+                for (int j = 0; j < 4096; j++) if (sections[i]->blocks[j]) owned[i]->blocks[j] = sections[i]->blocks[j];
+            }
+            secs[i] = owned[i];
+        }
+    }
 
     std::vector<Section*> present;
-    for (Section* s : sections) if (s && !(s->palette().size()==1 && s->palette()[0]->name()=="minecraft:air")) present.push_back(s);
+    for (Section* s : secs) if (s && !(s->palette().size()==1 && s->palette()[0]->name()=="minecraft:air")) present.push_back(s);
+    metrics::sections += present.size();
     put_u8(9); put_str("Sections"); put_u8(10); put_u32(present.size());
     for (Section* s : present) {
         put_u8(1); put_str("Y"); put_u8(s->y);
@@ -194,6 +446,7 @@ std::vector<uint8_t> Chunk::toNBT() const {
     put_u8(11); put_str("Biomes"); put_u32(1024);
     for (int i = 0; i < 1024; i++) put_u32(biomes[i]);
     put_u8(0); put_u8(0); // End Level, End root
+    for (Section* s : owned) delete s;
     return data;
 }
 
@@ -201,6 +454,30 @@ std::vector<uint8_t> Chunk::toNBT() const {
 Region::Region() {
     chunks.fill(nullptr);
     biomeGrid.resize(128, std::vector<int>(128, 1)); // Initialize with plains (ID 1)
+    memory::add(memory::chunks, sizeof(Region));
+    memory::add(memory::biomes, kRegionBiomeBytes);
+}
+
+Region::~Region() {
+    for (Chunk* c : chunks) delete c;
+    memory::add(memory::chunks, -(int64_t)sizeof(Region));
+    memory::add(memory::biomes, -kRegionBiomeBytes);
+}
+
+memory::Usage Region::memory() const {
+    memory::Usage u;
+    u.bytes[memory::chunks] = sizeof(Region);
+    u.bytes[memory::biomes] = kRegionBiomeBytes;
+    for (const Chunk* c : chunks) {
+        if (!c) continue;
+        u.bytes[memory::chunks] += sizeof(Chunk) + (c->columns ? c->columns->bytes() : 0);
+        u.objects[memory::chunks]++;
+        u.bytes[memory::biomes] += kChunkBiomeBytes;
+        u.objects[memory::biomes]++;
+        for (const Section* s : c->sections) if (s) u.objects[memory::sections]++;
+    }
+    u.bytes[memory::sections] = u.objects[memory::sections] * kSectionBytes;
+    return u;
 }
 
 int Region::index(int cx, int cz) const {
@@ -215,19 +492,37 @@ void Region::setBlock(const Block* block, int x, int y, int z) {
     chunks[idx]->setBlock(const_cast<Block*>(block), x % 16, y, z % 16); // Cast to non-const
 }
 
+void Region::setColumn(int x, int z, const Run* runs, int n) {
+    int cx = x / 16;
+    int cz = z / 16;
+    int idx = index(cx, cz);
+    if (!chunks[idx]) chunks[idx] = new Chunk(cx, cz);
+    chunks[idx]->setColumn(x % 16, z % 16, runs, n);
+}
+
 void Region::save(const std::string &fname) {
     struct Loc { int offset, count; };
     std::vector<Loc> locs(1024, {-1,0});
     std::vector<uint8_t> chunks_bytes;
+    memory::Hold file_buffer(memory::buffers);
     for (int i = 0; i < 1024; i++) {
         if (!chunks[i]) { locs[i] = {-1, 0}; continue; }
-        auto nbt = chunks[i]->toNBT();
+        std::vector<uint8_t> nbt;
+        memory::Hold chunk_buffers(memory::buffers);
+        {
+            metrics::Scope m(metrics::nbt);
+            nbt = chunks[i]->toNBT();
+            m.bytes_out = nbt.size();
+        }
+        metrics::Scope m(metrics::compress);
         uLongf compSize = compressBound(nbt.size());
         std::vector<uint8_t> comp(compSize);
         if (compress2(comp.data(), &compSize, nbt.data(), nbt.size(), Z_BEST_COMPRESSION) != Z_OK) {
             std::cerr << "ZLIB compress failed\n"; exit(1);
         }
         comp.resize(compSize);
+        m.bytes_in = nbt.size();
+        m.bytes_out = compSize;
         uint32_t len = comp.size() + 1;
         std::vector<uint8_t> blob(4 + 1 + comp.size());
         blob[0] = (len>>24)&0xFF; blob[1] = (len>>16)&0xFF; blob[2] = (len>>8)&0xFF; blob[3] = len&0xFF;
@@ -237,7 +532,9 @@ void Region::save(const std::string &fname) {
         locs[i] = {sector + 2, sectors};
         int pad = sectors*4096 - blob.size();
         blob.insert(blob.end(), pad, 0);
+        chunk_buffers.set(nbt.capacity() + comp.capacity() + blob.capacity());
         chunks_bytes.insert(chunks_bytes.end(), blob.begin(), blob.end());
+        file_buffer.set(chunks_bytes.capacity());
     }
     std::vector<uint8_t> locations(4096, 0);
     for (int i = 0; i < 1024; i++) if (locs[i].offset >= 0) {
@@ -247,6 +544,7 @@ void Region::save(const std::string &fname) {
         locations[4*i + 3] = locs[i].count & 0xFF;
     }
     std::vector<uint8_t> timestamps(4096, 0);
+    metrics::Scope m(metrics::write);
     std::ofstream fout(fname, std::ios::binary);
     fout.write(reinterpret_cast<char*>(locations.data()), locations.size());
     fout.write(reinterpret_cast<char*>(timestamps.data()), timestamps.size());
@@ -254,6 +552,7 @@ void Region::save(const std::string &fname) {
     std::streamoff fileSize = fout.tellp();
     int pad = 4096 - (fileSize % 4096);
     if (pad < 4096) { std::vector<uint8_t> pp(pad, 0); fout.write(reinterpret_cast<char*>(pp.data()), pad); }
+    m.bytes_out = fout.tellp();
     fout.close();
 }
 
@@ -266,6 +565,34 @@ void World::setBlock(const std::shared_ptr<const Block>& block, int x, int y, in
     regions[key]->setBlock(block.get(), x, y, z);
 }
 
+void World::setColumn(int x, int z, const Run* runs, int n) {
+    int rx = x / 512; if (x < 0 && x % 512 != 0) rx--;
+    int rz = z / 512; if (z < 0 && z % 512 != 0) rz--;
+    auto key = std::make_pair(rx, rz);
+    if (regions.find(key) == regions.end()) regions[key] = std::make_shared<Region>();
+    regions[key]->setColumn(x, z, runs, n);
+}
+
+Chunk* World::chunk(int cx, int cz) {
+    int rx = cx / 32; if (cx < 0 && cx % 32 != 0) rx--;
+    int rz = cz / 32; if (cz < 0 && cz % 32 != 0) rz--;
+    // No insertion when the region exists, so workers may look up pre-created chunks.
+    auto it = regions.find(std::make_pair(rx, rz));
+    if (it == regions.end()) it = regions.emplace(std::make_pair(rx, rz), std::make_shared<Region>()).first;
+    Region& region = *it->second;
+    int idx = region.index(cx, cz);
+    if (!region.chunks[idx]) region.chunks[idx] = new Chunk(cx, cz);
+    return region.chunks[idx];
+}
+
+Chunk* World::find(int cx, int cz) const {
+    int rx = cx / 32; if (cx < 0 && cx % 32 != 0) rx--;
+    int rz = cz / 32; if (cz < 0 && cz % 32 != 0) rz--;
+    auto it = regions.find(std::make_pair(rx, rz));
+    if (it == regions.end()) return nullptr;
+    return it->second->chunks[it->second->index(cx, cz)];
+}
+
 void World::setBiomeColumn(int x, int z, int minY, int maxY, int biomeId) {
     int rx = x / 512; if (x < 0 && x % 512 != 0) rx--;
     int rz = z / 512; if (z < 0 && z % 512 != 0) rz--;
@@ -297,6 +624,15 @@ void World::setBiomeColumn(int x, int z, int minY, int maxY, int biomeId) {
     }
 }
 
+void World::setBiomes(int cx, int cz, const int* quart) {
+    chunk(cx, cz)->setBiomes(quart);
+    int rx = cx / 32; if (cx < 0 && cx % 32 != 0) rx--;
+    int rz = cz / 32; if (cz < 0 && cz % 32 != 0) rz--;
+    auto& grid = regions.find(std::make_pair(rx, rz))->second->biomeGrid;
+    for (int qz = 0; qz < 4; qz++)
+        for (int qx = 0; qx < 4; qx++) grid[(cx % 32)*4 + qx][(cz % 32)*4 + qz] = quart[qz*4 + qx];
+}
+
 void World::save() {
     for (const auto& [key, region] : regions) {
         int rx = key.first;
@@ -306,3 +642,25 @@ void World::save() {
         std::cout << "Saved region to " << fname << "\n";
     }
 }
+
+void World::saveRow(int rz) {
+    for (auto it = regions.begin(); it != regions.end();) {
+        if (it->first.second != rz) { ++it; continue; }
+        std::string fname = "files/r." + std::to_string(it->first.first) + "." + std::to_string(rz) + ".mca";
+        it->second->save(fname);
+        std::cout << "Saved region to " << fname << "\n";
+        it = regions.erase(it);
+    }
+}
+
+memory::Usage World::memory() const {
+    memory::Usage u;
+    for (const auto& entry : regions) {
+        memory::Usage r = entry.second->memory();
+        for (int k = 0; k < memory::kKinds; k++) {
+            u.bytes[k] += r.bytes[k];
+            u.objects[k] += r.objects[k];
+        }
+    }
+    return u;
+}
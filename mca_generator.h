@@ -1,6 +1,7 @@
 #ifndef MCA_GENERATOR_H
 #define MCA_GENERATOR_H
 
+#include "memory.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -99,6 +100,9 @@ namespace block {
     DECLARE_BLOCK(raw_gold_block)
     DECLARE_BLOCK(raw_copper_block)
 #undef DECLARE_BLOCK
+
+    // Registered block by id ("stone") or full name ("minecraft:stone"), null if unknown.
+    std::shared_ptr<const Block> find(const std::string& name);
 }
 
 // Represents a 16×16×16 section of blocks at height Y.
@@ -109,20 +113,82 @@ struct Section {
     Block* air;
 
     Section(int y_);
+    ~Section();
+    Section(const Section&) = delete;
+    Section& operator=(const Section&) = delete;
     void setBlock(Block* block, int x, int yy, int z);
     std::vector<Block*> palette() const;
     std::vector<uint64_t> blockStates(const std::vector<Block*>& pal) const;
 };
 
+// A block and the topmost y it fills in a column, starting one above the previous run's top.
+struct Run {
+    const Block* block;
+    int top;
+};
+
+// Column-major scratch buffer for one chunk: cell index = (z*16 + x)*256 + y, so a
+// generator filling a column writes contiguous bytes. store() transposes it into
+// sections in their native YZX order a 16×16 block at a time.
+struct ChunkTile {
+    std::vector<const Block*> palette;  // index 0 = air
+    alignas(16) std::array<uint8_t, 256*256> cells;
+    int topY;                           // highest y written, -1 if empty
+
+    ChunkTile();
+    void clear();
+    uint8_t id(const Block* block);
+    uint8_t* column(int x, int z) { return &cells[(z*16 + x)*256]; }
+    void fill(int x, int z, int y0, int y1, uint8_t b);
+    void setColumn(int x, int z, const Run* runs, int n);
+    void store(std::array<Section*, 16>& out) const;
+};
+
+// One run as stored: index into the owning ColumnChunk palette and top y.
+struct ColumnRun {
+    uint8_t block;
+    uint8_t top;
+};
+
+// Run-length storage for the 16×16 columns of a chunk. A heightfield column is a handful
+// of runs (stone, dirt, grass, water) instead of 256 block pointers; sections are only
+// built from it when the chunk is serialized.
+struct ColumnChunk {
+    std::vector<const Block*> palette;  // index 0 = air
+    std::vector<ColumnRun> runs;
+    std::array<uint32_t, 256> start;    // first run of column z*16+x
+    std::array<uint8_t, 256> count;
+
+    ColumnChunk();
+    void setColumn(int x, int z, const Run* r, int n);
+    void materialize(std::array<Section*, 16>& out) const;
+    size_t bytes() const;
+};
+
+// Generation stages in order, named as in vanilla; a chunk's status is the last
+// stage it completed.
+enum class ChunkStatus { empty, noise, surface, carvers, features, light, heightmaps, full };
+const char* statusName(ChunkStatus status);
+
 // Represents one chunk at (cx, cz) relative to region, with up to 16 sections.
 struct Chunk {
     int cx, cz;
     std::array<Section*, 16> sections;
+    ColumnChunk* columns = nullptr; // optional column runs, below any blocks in sections
     std::vector<int> biomes; // Store 1024 biome IDs
+    std::array<int16_t, 256> heightmap; // highest non-air y + 1 per column (z*16 + x), 0 if empty
+    ChunkStatus status = ChunkStatus::full; // hand-built chunks count as finished
     int version = 2566;  // DataVersion
 
     Chunk(int cx_, int cz_);
+    ~Chunk();
+    Chunk(const Chunk&) = delete;
     void setBlock(Block* block, int x, int y, int z);
+    void setColumn(int x, int z, const Run* runs, int n);
+    void commit(const ChunkTile& tile);
+    void setBiomes(const int* quart);
+    void computeHeightmap();
+    const Block* blockAt(int x, int y, int z) const; // sections over column runs, null = air
     std::vector<uint8_t> toNBT() const;
 };
 
@@ -132,17 +198,28 @@ struct Region {
     std::vector<std::vector<int>> biomeGrid; // 128x128 grid for 4x4 resolution
 
     Region();
+    ~Region();
+    Region(const Region&) = delete;
     int index(int cx, int cz) const;
     void setBlock(const Block* block, int x, int y, int z); // Updated to const
+    void setColumn(int x, int z, const Run* runs, int n);
     void save(const std::string &fname);
+    memory::Usage memory() const; // block storage held by this region now
 };
 
 struct World {
     std::map<std::pair<int, int>, std::shared_ptr<Region>> regions;
 
     void setBlock(const std::shared_ptr<const Block>& block, int x, int y, int z); // Updated to const
+    void setColumn(int x, int z, const Run* runs, int n);
+    Chunk* chunk(int cx, int cz);
+    Chunk* find(int cx, int cz) const; // null if the chunk was never created
     void setBiomeColumn(int x, int z, int minY, int maxY, int biomeId);
+    void setBiomes(int cx, int cz, const int* quart);
     void save();
+    // Saves the regions of region row rz and frees them.
+    void saveRow(int rz);
+    memory::Usage memory() const;
 };
 
 #endif
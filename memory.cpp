@@ -0,0 +1,64 @@
+#include "memory.h"
+#include <iomanip>
+
+namespace memory {
+
+static std::atomic<int64_t> kind_bytes[kKinds], kind_objects[kKinds], kind_peak[kKinds];
+static std::atomic<int64_t> total_bytes{0}, total_peak{0}, limit{0};
+static std::atomic<bool> over{false};
+
+const char* kindName(Kind kind) {
+    static const char* names[kKinds] = {"sections", "chunks", "biomes", "buffers"};
+    return names[kind];
+}
+
+int64_t Usage::total() const {
+    int64_t t = 0;
+    for (int k = 0; k < kKinds; k++) t += bytes[k];
+    return t;
+}
+
+static void raise(std::atomic<int64_t>& peak, int64_t value) {
+    int64_t p = peak.load(std::memory_order_relaxed);
+    while (value > p && !peak.compare_exchange_weak(p, value, std::memory_order_relaxed)) {}
+}
+
+void add(Kind kind, int64_t bytes, int64_t objects) {
+    int64_t k = kind_bytes[kind].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t t = total_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (objects) kind_objects[kind].fetch_add(objects, std::memory_order_relaxed);
+    if (bytes <= 0) return;
+    raise(kind_peak[kind], k);
+    raise(total_peak, t);
+    int64_t l = limit.load(std::memory_order_relaxed);
+    if (l && t > l) over.store(true, std::memory_order_relaxed);
+}
+
+Usage live() {
+    Usage u;
+    for (int k = 0; k < kKinds; k++) {
+        u.bytes[k] = kind_bytes[k].load(std::memory_order_relaxed);
+        u.objects[k] = kind_objects[k].load(std::memory_order_relaxed);
+    }
+    return u;
+}
+
+int64_t total() { return total_bytes.load(std::memory_order_relaxed); }
+int64_t peak() { return total_peak.load(std::memory_order_relaxed); }
+int64_t peak(Kind kind) { return kind_peak[kind].load(std::memory_order_relaxed); }
+void setLimit(int64_t bytes) { limit = bytes; }
+bool overLimit() { return over.load(std::memory_order_relaxed); }
+
+void print(std::ostream& out, const Usage& usage) {
+    auto flags = out.flags();
+    auto mib = [](int64_t b) { return b / 1048576.0; };
+    out << std::fixed << std::setprecision(1) << " " << mib(usage.total()) << " MiB";
+    for (int k = 0; k < kKinds; k++) {
+        out << (k ? ", " : " (") << kindName((Kind)k) << " " << mib(usage.bytes[k]) << " MiB";
+        if (usage.objects[k]) out << " in " << usage.objects[k];
+    }
+    out << ")";
+    out.flags(flags);
+}
+
+}
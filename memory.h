@@ -0,0 +1,45 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// Live bytes and object counts of the world's block storage, by kind, with the peak
+// of the total. Section, Chunk and Region constructors and destructors report here,
+// as do the serialization buffers of Region::save. With a limit set, the allocation
+// that takes the total over it raises a flag; the main thread checks it between chunk
+// rows and ends the run with a breakdown instead of leaving it to the OOM killer.
+namespace memory {
+
+enum Kind { sections, chunks, biomes, buffers, kKinds };
+const char* kindName(Kind kind);
+
+// A snapshot; Region::memory() and World::memory() fill one by walking their chunks.
+struct Usage {
+    int64_t bytes[kKinds] = {}, objects[kKinds] = {};
+    int64_t total() const;
+};
+
+void add(Kind kind, int64_t bytes, int64_t objects = 0);
+Usage live();
+int64_t total();
+int64_t peak();
+int64_t peak(Kind kind); // high-water mark of one kind, not necessarily at peak()
+void setLimit(int64_t bytes); // 0 = none
+bool overLimit();             // the total has gone over the limit at some point
+void print(std::ostream& out, const Usage& usage);
+
+// Accounts a buffer of changing size; set() to its current size, released at scope end.
+struct Hold {
+    Kind kind;
+    int64_t bytes = 0;
+    explicit Hold(Kind kind_) : kind(kind_) {}
+    Hold(const Hold&) = delete;
+    ~Hold() { set(0); }
+    void set(int64_t n) { add(kind, n - bytes); bytes = n; }
+};
+
+}
+
+#endif
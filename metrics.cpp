@@ -0,0 +1,80 @@
+#include "metrics.h"
+#include "trace.h"
+#include "memory.h"
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace metrics {
+
+static Totals stage_totals[kStages];
+std::atomic<uint64_t> sections{0};
+
+const char* stageName(Stage stage) {
+    static const char* names[kStages] = {"noise", "erosion", "rivers", "biomes", "fill", "surface", "carvers",
+                                         "features", "commit", "finish", "nbt", "compress", "write"};
+    return names[stage];
+}
+
+Totals& totals(Stage stage) { return stage_totals[stage]; }
+
+static uint64_t now(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+Scope::Scope(Stage stage_, uint64_t items_)
+    : stage(stage_), items(items_), wall0(now(CLOCK_MONOTONIC)), cpu0(now(CLOCK_THREAD_CPUTIME_ID)) {}
+
+Scope::~Scope() {
+    Totals& t = stage_totals[stage];
+    uint64_t wall1 = now(CLOCK_MONOTONIC);
+    if (trace::enabled) trace::record(stageName(stage), wall0, wall1);
+    t.wall_ns += wall1 - wall0;
+    t.cpu_ns += now(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+    t.calls++;
+    t.items += items;
+    t.bytes_in += bytes_in;
+    t.bytes_out += bytes_out;
+}
+
+void writeReport(const std::string& path, double elapsed_s, int threads) {
+    std::ofstream out(path);
+    if (!out) { std::cerr << "Cannot open " << path << "\n"; exit(1); }
+    auto rate = [](double n, double s) { return s > 0 ? n / s : 0.0; };
+    uint64_t chunks = stage_totals[nbt].items, written = stage_totals[write].bytes_out;
+    out << std::fixed << std::setprecision(6);
+    out << "{\n";
+    out << "  \"elapsed_s\": " << elapsed_s << ",\n";
+    out << "  \"cpu_s\": " << now(CLOCK_PROCESS_CPUTIME_ID) * 1e-9 << ",\n";
+    out << "  \"threads\": " << threads << ",\n";
+    out << "  \"chunks\": " << chunks << ",\n";
+    out << "  \"chunks_per_s\": " << rate(chunks, elapsed_s) << ",\n";
+    out << "  \"sections_per_chunk\": " << rate(sections, chunks) << ",\n";
+    out << "  \"bytes_written\": " << written << ",\n";
+    out << "  \"memory\": {\"peak_bytes\": " << memory::peak();
+    for (int k = 0; k < memory::kKinds; k++)
+        out << ", \"" << memory::kindName((memory::Kind)k) << "_peak_bytes\": " << memory::peak((memory::Kind)k);
+    out << "},\n";
+    out << "  \"stages\": {";
+    const char* sep = "\n";
+    for (int s = 0; s < kStages; s++) {
+        const Totals& t = stage_totals[s];
+        if (!t.calls) continue;
+        double wall = t.wall_ns * 1e-9;
+        out << sep << "    \"" << stageName((Stage)s) << "\": {"
+            << "\"wall_s\": " << wall << ", \"cpu_s\": " << t.cpu_ns * 1e-9
+            << ", \"calls\": " << t.calls << ", \"items\": " << t.items
+            << ", \"items_per_s\": " << rate(t.items, wall)
+            << ", \"bytes_in\": " << t.bytes_in << ", \"bytes_out\": " << t.bytes_out
+            << ", \"mb_out_per_s\": " << rate(t.bytes_out / 1e6, wall);
+        if (t.bytes_in && t.bytes_out) out << ", \"ratio\": " << (double)t.bytes_in / t.bytes_out;
+        out << "}";
+        sep = ",\n";
+    }
+    out << "\n  }\n}\n";
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Run totals per generation stage. A Scope adds its wall and thread CPU time to its
+// stage when it ends, so stages running on several workers report summed busy time
+// (compare with the run's elapsed time for the parallel speedup). Counting is always
+// on; it is a pair of clock reads per scope. With MCA_TRACE every scope is also a
+// trace span named after its stage.
+namespace metrics {
+
+enum Stage { noise, erosion, rivers, biomes, fill, surface, carvers, features, commit, finish,
+             nbt, compress, write, kStages };
+const char* stageName(Stage stage);
+
+struct Totals {
+    std::atomic<uint64_t> wall_ns{0}, cpu_ns{0}, calls{0};
+    std::atomic<uint64_t> items{0};     // chunks, or columns for the noise stages
+    std::atomic<uint64_t> bytes_in{0}, bytes_out{0};
+};
+Totals& totals(Stage stage);
+extern std::atomic<uint64_t> sections; // non-empty sections written
+
+struct Scope {
+    Stage stage;
+    uint64_t items, bytes_in = 0, bytes_out = 0;
+    uint64_t wall0, cpu0;
+
+    explicit Scope(Stage stage_, uint64_t items_ = 1);
+    ~Scope();
+};
+
+// JSON report of all stages plus run-level figures; elapsed_s is the run's wall time.
+void writeReport(const std::string& path, double elapsed_s, int threads);
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include "noise.h"
+#include "trace.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+float fade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+
+float lerp(float a, float b, float t) { return a + t * (b - a); }
+
+float grad(int hash, float x, float y) {
+    int h = hash & 7;
+    float u = h < 4 ? x : y;
+    float v = h < 4 ? y : x;
+    return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f * v : 2.0f * v);
+}
+
+// Permutation table, shuffled with the seed of the first call.
+static const uint8_t* permutation(int seed) {
+    static uint8_t p[512];
+    static bool initialized = false;
+    if (!initialized) {
+        for (int i = 0; i < 256; i++) p[i] = i;
+        std::shuffle(p, p + 256, std::mt19937(seed));
+        for (int i = 0; i < 256; i++) p[256 + i] = p[i];
+        initialized = true;
+    }
+    return p;
+}
+
+float perlin(float x, float y, int seed) {
+    int xi = (int)std::floor(x) & 255;
+    int yi = (int)std::floor(y) & 255;
+
+    float xf = x - std::floor(x);
+    float yf = y - std::floor(y);
+
+    float u = fade(xf);
+    float v = fade(yf);
+
+    const uint8_t* p = permutation(seed);
+
+    int aa = p[p[xi] + yi];
+    int ab = p[p[xi] + yi + 1];
+    int ba = p[p[xi + 1] + yi];
+    int bb = p[p[xi + 1] + yi + 1];
+
+    float x1 = lerp(grad(aa, xf, yf), grad(ba, xf - 1, yf), u);
+    float x2 = lerp(grad(ab, xf, yf - 1), grad(bb, xf - 1, yf - 1), u);
+
+    return (lerp(x1, x2, v) + 1.0f) * 0.5f; // normalize 0..1
+}
+
+// grad(hash, x, y) == gx*x + gy*y
+static void gradVector(int hash, float& gx, float& gy) {
+    int h = hash & 7;
+    float su = (h & 1) ? -1.0f : 1.0f;
+    float sv = (h & 2) ? -2.0f : 2.0f;
+    gx = h < 4 ? su : sv;
+    gy = h < 4 ? sv : su;
+}
+
+void perlinGrid(const float* xs, int w, const float* ys, int h, float* out, int seed) {
+    const uint8_t* p = permutation(seed);
+    std::vector<int> xi(w);
+    std::vector<float> xf(w), u(w);
+    for (int i = 0; i < w; i++) {
+        xi[i] = (int)std::floor(xs[i]) & 255;
+        xf[i] = xs[i] - std::floor(xs[i]);
+        u[i] = fade(xf[i]);
+    }
+    std::vector<int> yi(h);
+    std::vector<float> yf(h), v(h);
+    for (int j = 0; j < h; j++) {
+        yi[j] = (int)std::floor(ys[j]) & 255;
+        yf[j] = ys[j] - std::floor(ys[j]);
+        v[j] = fade(yf[j]);
+    }
+    // One lattice cell at a time: runs of samples with the same cell index in x and in
+    // y share its four corner gradients, which are hashed once for the whole rectangle.
+    for (int j0 = 0, j1; j0 < h; j0 = j1) {
+        int cy = yi[j0];
+        for (j1 = j0 + 1; j1 < h && yi[j1] == cy; j1++) {}
+        for (int i0 = 0, i1; i0 < w; i0 = i1) {
+            int cx = xi[i0];
+            for (i1 = i0 + 1; i1 < w && xi[i1] == cx; i1++) {}
+            float aax, aay, abx, aby, bax, bay, bbx, bby;
+            gradVector(p[p[cx] + cy], aax, aay);
+            gradVector(p[p[cx] + cy + 1], abx, aby);
+            gradVector(p[p[cx + 1] + cy], bax, bay);
+            gradVector(p[p[cx + 1] + cy + 1], bbx, bby);
+            for (int j = j0; j < j1; j++) {
+                float y0 = yf[j], y1 = yf[j] - 1;
+                float* row = out + j*w;
+                for (int i = i0; i < i1; i++) {
+                    float x0 = xf[i], x1 = xf[i] - 1;
+                    float a = lerp(aax*x0 + aay*y0, bax*x1 + bay*y0, u[i]);
+                    float b = lerp(abx*x0 + aby*y1, bbx*x1 + bby*y1, u[i]);
+                    row[i] = (lerp(a, b, v[j]) + 1.0f) * 0.5f;
+                }
+            }
+        }
+    }
+}
+
+float fbm(float x, float y, int octaves, float lacunarity, float gain) {
+    float total = 0.0f, amplitude = 1.0f, frequency = 1.0f;
+    for (int i = 0; i < octaves; ++i) {
+        total += perlin(x * frequency, y * frequency) * amplitude;
+        amplitude *= gain;
+        frequency *= lacunarity;
+    }
+    return total / ((1.0f - std::pow(gain, octaves)) / (1.0f - gain));
+}
+
+void fbmGrid(const float* xs, int w, const float* ys, int h, float* out, int octaves, float lacunarity, float gain,
+             int visible) {
+    TRACE_SCOPE("fbm");
+    std::vector<float> fx(w), fy(h), layer(w * h);
+    std::fill(out, out + w*h, 0.0f);
+    float amplitude = 1.0f, frequency = 1.0f;
+    int summed = visible < 0 ? octaves : std::min(visible, octaves);
+    for (int o = 0; o < summed; ++o) {
+        for (int i = 0; i < w; i++) fx[i] = xs[i] * frequency;
+        for (int j = 0; j < h; j++) fy[j] = ys[j] * frequency;
+        perlinGrid(fx.data(), w, fy.data(), h, layer.data());
+        for (int k = 0; k < w*h; k++) out[k] += layer[k] * amplitude;
+        amplitude *= gain;
+        frequency *= lacunarity;
+    }
+    // Skipped octaves contribute their mean, 0.5 each.
+    float rest = 0.0f;
+    for (int o = summed; o < octaves; ++o, amplitude *= gain) rest += 0.5f * amplitude;
+    if (rest != 0.0f) for (int k = 0; k < w*h; k++) out[k] += rest;
+    float norm = (1.0f - std::pow(gain, octaves)) / (1.0f - gain);
+    for (int k = 0; k < w*h; k++) out[k] /= norm;
+}
+
+int visibleOctaves(float frequency, int octaves, float stride, float lacunarity) {
+    int n = 1;
+    for (float f = frequency * lacunarity; n < octaves && f * stride <= 0.5f; f *= lacunarity) n++;
+    return n;
+}
+
+float fbmHash(double x, double y, uint64_t seed, int octaves, double lacunarity, double gain, int visible) {
+    double total = 0.0, amplitude = 1.0, frequency = 1.0;
+    int summed = visible < 0 ? octaves : std::min(visible, octaves);
+    for (int i = 0; i < summed; ++i) {
+        total += hashNoise(x * frequency, y * frequency, seed + i) * amplitude;
+        amplitude *= gain;
+        frequency *= lacunarity;
+    }
+    for (int i = summed; i < octaves; ++i, amplitude *= gain) total += 0.5 * amplitude; // skipped octaves' mean
+    return (float)(total / ((1.0 - std::pow(gain, octaves)) / (1.0 - gain)));
+}
+
+void hashNoiseRow(double x0, double dx, double y, int n, uint64_t seed, float* out) {
+    for (int i = 0; i < n; i++) out[i] = hashNoise(x0 + i * dx, y, seed);
+}
@@ -0,0 +1,160 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+float fade(float t);
+float lerp(float a, float b, float t);
+float grad(int hash, float x, float y);
+float perlin(float x, float y, int seed = 5);
+float fbm(float x, float y, int octaves = 4, float lacunarity = 2.0f, float gain = 0.5f);
+
+// perlin() at every (xs[i], ys[j]), out[j*w + i]. Walks the grid lattice cell by lattice
+// cell, filling the rectangle of samples inside each, so the permutation lookups and
+// corner gradients are done once per cell, not per sample or per row.
+// Results are identical to perlin().
+void perlinGrid(const float* xs, int w, const float* ys, int h, float* out, int seed = 5);
+
+// fbm() at every (xs[i], ys[j]) through perlinGrid, one pass per octave; identical to fbm().
+// With `visible` >= 0 only the first `visible` octaves are evaluated and the others add
+// their mean (0.5 each), still normalized as the full fBm. That is the low-pass version
+// of the full fBm for previews, unbiased in height.
+void fbmGrid(const float* xs, int w, const float* ys, int h, float* out, int octaves = 4, float lacunarity = 2.0f, float gain = 0.5f,
+             int visible = -1);
+
+// Octaves of an fBm with base frequency `frequency` (lattice cells per block) that samples
+// every `stride` blocks can still resolve; the others are above the Nyquist limit. At least 1.
+int visibleOctaves(float frequency, int octaves, float stride, float lacunarity = 2.0f);
+
+// Hashed gradient noise: corner gradients come from an integer hash of (seed, xi, yi)
+// instead of the 256-entry permutation table, so there are no lookups, lattice
+// coordinates are 64-bit and the pattern never repeats. Everything is inline and
+// branch-free so loops over it vectorize.
+inline uint64_t hashLattice(uint64_t seed, int64_t xi, int64_t yi) {
+    uint64_t h = seed ^ ((uint64_t)xi * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)yi * 0xC2B2AE3D27D4EB4FULL);
+    h ^= h >> 31; h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 29; h *= 0x94D049BB133111EBULL;
+    return h ^ (h >> 32);
+}
+
+// Same 8 gradients as grad(), picked from the top hash bits.
+inline double hashGrad(uint64_t h, double x, double y) {
+    uint64_t g = h >> 61;
+    double u = (g & 4) ? y : x;
+    double v = (g & 4) ? x : y;
+    return (1.0 - 2.0 * (double)(g & 1)) * u + (2.0 - 4.0 * (double)((g >> 1) & 1)) * v;
+}
+
+inline float hashNoise(double x, double y, uint64_t seed) {
+    double fx = std::floor(x), fy = std::floor(y);
+    int64_t xi = (int64_t)fx, yi = (int64_t)fy;
+    double xf = x - fx, yf = y - fy;
+    double u = xf * xf * xf * (xf * (xf * 6 - 15) + 10);
+    double v = yf * yf * yf * (yf * (yf * 6 - 15) + 10);
+
+    double aa = hashGrad(hashLattice(seed, xi, yi), xf, yf);
+    double ba = hashGrad(hashLattice(seed, xi + 1, yi), xf - 1, yf);
+    double ab = hashGrad(hashLattice(seed, xi, yi + 1), xf, yf - 1);
+    double bb = hashGrad(hashLattice(seed, xi + 1, yi + 1), xf - 1, yf - 1);
+
+    double x1 = aa + u * (ba - aa);
+    double x2 = ab + u * (bb - ab);
+    return (float)((x1 + v * (x2 - x1) + 1.0) * 0.5); // normalize 0..1
+}
+
+inline uint64_t hashLattice3(uint64_t seed, int64_t xi, int64_t yi, int64_t zi) {
+    return hashLattice(seed ^ ((uint64_t)zi * 0xD6E8FEB86659FD93ULL), xi, yi);
+}
+
+// Improved Perlin's 12 edge gradients (16 with repeats) from the top 4 hash bits.
+inline double hashGrad3(uint64_t h, double x, double y, double z) {
+    uint64_t g = h >> 60;
+    double u = g < 8 ? x : y;
+    double v = g < 4 ? y : ((g == 12 || g == 14) ? x : z);
+    return (1.0 - 2.0 * (double)(g & 1)) * u + (1.0 - 2.0 * (double)((g >> 1) & 1)) * v;
+}
+
+// 3D hashed gradient noise, normalized 0..1.
+inline float hashNoise3(double x, double y, double z, uint64_t seed) {
+    double fx = std::floor(x), fy = std::floor(y), fz = std::floor(z);
+    int64_t xi = (int64_t)fx, yi = (int64_t)fy, zi = (int64_t)fz;
+    double xf = x - fx, yf = y - fy, zf = z - fz;
+    double u = xf * xf * xf * (xf * (xf * 6 - 15) + 10);
+    double v = yf * yf * yf * (yf * (yf * 6 - 15) + 10);
+    double w = zf * zf * zf * (zf * (zf * 6 - 15) + 10);
+
+    double c[8];
+    for (int i = 0; i < 8; i++) {
+        int dx = i & 1, dy = (i >> 1) & 1, dz = i >> 2;
+        c[i] = hashGrad3(hashLattice3(seed, xi + dx, yi + dy, zi + dz), xf - dx, yf - dy, zf - dz);
+    }
+    double x00 = c[0] + u * (c[1] - c[0]), x10 = c[2] + u * (c[3] - c[2]);
+    double x01 = c[4] + u * (c[5] - c[4]), x11 = c[6] + u * (c[7] - c[6]);
+    double y0 = x00 + v * (x10 - x00), y1 = x01 + v * (x11 - x01);
+    return (float)((y0 + w * (y1 - y0) + 1.0) * 0.5);
+}
+
+// fbm() over hashNoise; each octave gets its own seed. `visible` as in fbmGrid.
+float fbmHash(double x, double y, uint64_t seed, int octaves = 4, double lacunarity = 2.0, double gain = 0.5, int visible = -1);
+
+// hashNoise at (x0 + i*dx, y) for i in [0, n).
+void hashNoiseRow(double x0, double dx, double y, int n, uint64_t seed, float* out);
+
+// Evaluates f(x, z) on a lattice every `step` blocks and interpolates inside each cell,
+// bilinearly or with Catmull-Rom bicubic when `cubic` is set. The lattice is anchored at
+// world multiples of `step`, so adjacent windows agree on their shared edges.
+// Fills the row-major w×h window at (x0, z0) with about (w/step)*(h/step) calls to f.
+template <class F>
+void sampleCoarse(F f, int x0, int z0, int w, int h, int step, bool cubic, float* out) {
+    auto floorDiv = [](int a, int b) { return a / b - (a % b != 0 && a < 0); };
+    int pad = cubic ? 1 : 0;
+    int gx0 = floorDiv(x0, step) - pad, gz0 = floorDiv(z0, step) - pad;
+    int gw = floorDiv(x0 + w - 1, step) + 1 + pad - gx0 + 1;
+    int gh = floorDiv(z0 + h - 1, step) + 1 + pad - gz0 + 1;
+    std::vector<float> grid(gw * gh);
+    for (int j = 0; j < gh; j++)
+        for (int i = 0; i < gw; i++) grid[j*gw + i] = f((gx0 + i) * step, (gz0 + j) * step);
+
+    auto cr = [](float p0, float p1, float p2, float p3, float t) {
+        return p1 + 0.5f * t * (p2 - p0 + t * (2*p0 - 5*p1 + 4*p2 - p3 + t * (3*(p1 - p2) + p3 - p0)));
+    };
+    float inv = 1.0f / step;
+    for (int z = 0; z < h; z++) {
+        int wz = z0 + z, cz = floorDiv(wz, step);
+        float tz = (wz - cz * step) * inv;
+        const float* row = &grid[(cz - gz0) * gw];
+        for (int x = 0; x < w; x++) {
+            int wx = x0 + x, cx = floorDiv(wx, step);
+            float tx = (wx - cx * step) * inv;
+            const float* c = row + (cx - gx0);
+            if (!cubic) {
+                float a = c[0] + tx * (c[1] - c[0]);
+                float b = c[gw] + tx * (c[gw + 1] - c[gw]);
+                out[z*w + x] = a + tz * (b - a);
+            } else {
+                float r[4];
+                for (int k = 0; k < 4; k++) {
+                    const float* q = c + (k - 1) * gw;
+                    r[k] = cr(q[-1], q[0], q[1], q[2], tx);
+                }
+                out[z*w + x] = cr(r[0], r[1], r[2], r[3], tz);
+            }
+        }
+    }
+}
+
+// Largest |sampleCoarse - f| over the window, for checking a step against an error bound.
+template <class F>
+float coarseError(F f, int x0, int z0, int w, int h, int step, bool cubic) {
+    std::vector<float> approx(w * h);
+    sampleCoarse(f, x0, z0, w, h, step, cubic, approx.data());
+    float err = 0.0f;
+    for (int z = 0; z < h; z++)
+        for (int x = 0; x < w; x++) err = std::max(err, std::fabs(approx[z*w + x] - f(x0 + x, z0 + z)));
+    return err;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#include "noise_cache.h"
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+static const uint32_t kMagic = 0x434E434D; // "MCNC"
+static const size_t kKeep = 4;              // cache files kept per directory, this one included
+
+namespace {
+struct Header {
+    uint32_t magic;
+    int32_t width, depth;
+    uint32_t pad;
+    uint64_t key;
+};
+}
+
+void NoiseCache::open(const std::string& dir, uint64_t key, int width_, int depth_) {
+    width = width_;
+    depth = depth_;
+    char name[32];
+    snprintf(name, sizeof(name), "noise.%016llx.bin", (unsigned long long)key);
+    std::filesystem::create_directories(dir);
+    std::string path = dir + "/" + name;
+
+    size_t rows = depth / 16, flags_size = (rows + 63) / 64 * 64;
+    size = sizeof(Header) + flags_size + ((size_t)width*depth + (size_t)(width/4)*(depth/4)) * sizeof(float);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) { std::cerr << "Cannot open " << path << "\n"; exit(1); }
+    Header want = {kMagic, width, depth, 0, key}, have = {};
+    bool valid = pread(fd, &have, sizeof(have), 0) == sizeof(have) && have.magic == want.magic &&
+                 have.width == width && have.depth == depth && have.key == key &&
+                 (size_t)lseek(fd, 0, SEEK_END) == size;
+    if (!valid && (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0 || pwrite(fd, &want, sizeof(want), 0) != sizeof(want))) {
+        std::cerr << "Cannot size " << path << "\n"; exit(1);
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) { std::cerr << "Cannot map " << path << "\n"; exit(1); }
+    // Files of other keys are kept for switching back, least recently opened first out.
+    namespace fs = std::filesystem;
+    fs::last_write_time(path, fs::file_time_type::clock::now());
+    std::vector<std::pair<fs::file_time_type, fs::path>> others;
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        std::string f = entry.path().filename().string();
+        if (f.rfind("noise.", 0) == 0 && f != name) others.push_back({fs::last_write_time(entry.path()), entry.path()});
+    }
+    std::sort(others.begin(), others.end(), std::greater<>());
+    for (size_t i = kKeep - 1; i < others.size(); i++) fs::remove(others[i].second);
+    base = (uint8_t*)p;
+    flags = base + sizeof(Header);
+    heights_ = (float*)(flags + flags_size);
+    biomes_ = heights_ + (size_t)width*depth;
+}
+
+bool NoiseCache::complete() const {
+    if (!base) return false;
+    for (int cz = 0; cz < depth / 16; cz++) if (!has(cz)) return false;
+    return true;
+}
+
+NoiseCache::~NoiseCache() {
+    if (base) munmap(base, size);
+}
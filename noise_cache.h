@@ -0,0 +1,37 @@
+#ifndef NOISE_CACHE_H
+#define NOISE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Normalized heights and quart biome values of every chunk row, memory-mapped from
+// dir/noise.<key>.bin. The key covers only the inputs of the height and biome fields,
+// so any change to them maps a different file while e.g. sea level or river settings
+// reuse it. Files for other keys stay until more than four are cached, then the least
+// recently opened go. Each row has a done flag, set after its values are written, so
+// an interrupted run keeps the rows it finished.
+struct NoiseCache {
+    int width = 0, depth = 0;
+
+    NoiseCache() = default;
+    NoiseCache(const NoiseCache&) = delete;
+    ~NoiseCache();
+
+    // Maps (creating if needed) the cache for a width×depth world.
+    void open(const std::string& dir, uint64_t key, int width, int depth);
+    bool enabled() const { return base != nullptr; }
+    bool has(int cz) const { return base && flags[cz]; }
+    bool complete() const; // every row cached; false when not opened
+    float* heights(int cz) { return heights_ + (size_t)cz*16*width; } // 16 rows of width
+    float* biomes(int cz) { return biomes_ + (size_t)cz*4*(width/4); } // 4 rows of width/4
+    void done(int cz) { flags[cz] = 1; }
+
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    uint8_t* flags = nullptr;
+    float* heights_ = nullptr;
+    float* biomes_ = nullptr;
+};
+
+#endif
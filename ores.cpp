@@ -0,0 +1,38 @@
+#include "ores.h"
+#include "rng.h"
+
+std::vector<OreConfig> defaultOres() {
+    return {
+        {block::coal_ore.get(), 20, 17, 0, 127},
+        {block::iron_ore.get(), 20, 9, 0, 63},
+        {block::copper_ore.get(), 6, 10, 0, 95},
+        {block::gold_ore.get(), 2, 9, 0, 31},
+        {block::redstone_ore.get(), 8, 8, 0, 15},
+        {block::lapis_ore.get(), 1, 7, 0, 30},
+        {block::diamond_ore.get(), 1, 8, 0, 15},
+        {block::emerald_ore.get(), 1, 1, 4, 31},
+    };
+}
+
+void placeOres(ChunkTile& tile, int cx, int cz, uint64_t seed, const std::vector<OreConfig>& ores) {
+    uint8_t stone = tile.id(block::stone.get());
+    for (size_t f = 0; f < ores.size(); f++) {
+        const OreConfig& o = ores[f];
+        uint8_t ore = tile.id(o.ore);
+        ChunkRng rng(seed, cx, cz, f);
+        for (int v = 0; v < o.veins; v++) {
+            // Random walk from the vein start, one block per step.
+            int x = rng.range(0, 15), y = rng.range(o.min_y, o.max_y), z = rng.range(0, 15);
+            for (int s = 0; s < o.size; s++) {
+                if (x >= 0 && x < 16 && z >= 0 && z < 16 && y >= 0 && y < 256) {
+                    uint8_t& c = tile.column(x, z)[y];
+                    c = c == stone ? ore : c;
+                }
+                uint32_t step = rng.next();
+                x += (int)(step % 3) - 1;
+                y += (int)((step >> 8) % 3) - 1;
+                z += (int)((step >> 16) % 3) - 1;
+            }
+        }
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef ORES_H
+#define ORES_H
+
+#include "mca_generator.h"
+#include <vector>
+
+// One ore kind: `veins` blobs of up to `size` blocks per chunk between min_y and max_y.
+// The ore replaces stone.
+struct OreConfig {
+    const Block* ore;
+    int veins, size;
+    int min_y, max_y;
+};
+
+std::vector<OreConfig> defaultOres();
+
+// Places ore veins in the tile of chunk (cx, cz). Every draw comes from a ChunkRng keyed
+// on (seed, cx, cz, ore index) and veins are clipped to the chunk, so the result only
+// depends on the chunk itself and chunks can be processed in any order or in parallel.
+void placeOres(ChunkTile& tile, int cx, int cz, uint64_t seed, const std::vector<OreConfig>& ores);
+
+#endif
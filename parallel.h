@@ -0,0 +1,33 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Worker count for parallel stages: hardware threads, at least 1.
+inline int defaultThreads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs fn(i, worker) for i in [0, n) on `threads` workers; worker is in [0, threads)
+// so callers can keep per-worker scratch. Items are handed out one at a time.
+template <class F>
+void parallelFor(int n, int threads, F fn) {
+    threads = std::max(1, std::min(threads, n));
+    if (threads == 1) {
+        for (int i = 0; i < n; i++) fn(i, 0);
+        return;
+    }
+    std::atomic<int> next{0};
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t] {
+            for (int i; (i = next++) < n;) fn(i, t);
+        });
+    }
+    for (auto& th : pool) th.join();
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "png_writer.h"
+#include <algorithm>
+#include <iostream>
+#include <zlib.h>
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+PngWriter::PngWriter(const std::string& fname, int width_, int height_, int channels_, int strip_rows_, int level_)
+    : out(fname, std::ios::binary), width(width_), height(height_), channels(channels_),
+      strip_rows(strip_rows_), strips((height_ + strip_rows_ - 1) / strip_rows_), level(level_) {
+    if (!out) { std::cerr << "Cannot open " << fname << "\n"; exit(1); }
+    static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.write((const char*)sig, 8);
+    uint8_t ihdr[13];
+    put_u32(ihdr, width);
+    put_u32(ihdr + 4, height);
+    static const uint8_t color_type[5] = {0, 0, 4, 2, 6};
+    ihdr[8] = 8;                     // bit depth
+    ihdr[9] = color_type[channels];  // gray, gray+alpha, RGB, RGBA
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    chunk("IHDR", ihdr, 13);
+    static const uint8_t zlib_header[2] = {0x78, 0x01};
+    chunk("IDAT", zlib_header, 2);
+}
+
+void PngWriter::chunk(const char* type, const uint8_t* data, size_t n) {
+    uint8_t head[8];
+    put_u32(head, n);
+    for (int i = 0; i < 4; i++) head[4 + i] = type[i];
+    uLong crc = crc32(0, head + 4, 4);
+    if (n) crc = crc32(crc, data, n); // a null buffer would reset the crc
+    uint8_t tail[4];
+    put_u32(tail, crc);
+    out.write((const char*)head, 8);
+    out.write((const char*)data, n);
+    out.write((const char*)tail, 4);
+}
+
+void PngWriter::strip(int index, const uint8_t* pixels) {
+    int rows = std::min(strip_rows, height - index*strip_rows);
+    size_t stride = (size_t)width * channels;
+
+    // The first row of a strip uses Sub so strips stay independent; the rest use Up,
+    // which suits smooth terrain and needs no per-row filter search.
+    std::vector<uint8_t> raw(rows * (stride + 1));
+    for (int r = 0; r < rows; r++) {
+        const uint8_t* row = pixels + r*stride;
+        uint8_t* f = &raw[r*(stride + 1)];
+        if (r == 0) {
+            f[0] = 1;
+            for (int i = 0; i < channels; i++) f[1 + i] = row[i];
+            for (size_t i = channels; i < stride; i++) f[1 + i] = row[i] - row[i - channels];
+        } else {
+            const uint8_t* up = row - stride;
+            f[0] = 2;
+            for (size_t i = 0; i < stride; i++) f[1 + i] = row[i] - up[i];
+        }
+    }
+
+    Deflated d;
+    d.raw = raw.size();
+    d.adler = adler32(1, raw.data(), raw.size());
+    z_stream zs = {};
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        std::cerr << "deflateInit2 failed\n"; exit(1);
+    }
+    d.data.resize(deflateBound(&zs, raw.size()) + 16);
+    zs.next_in = raw.data();
+    zs.avail_in = raw.size();
+    zs.next_out = d.data.data();
+    zs.avail_out = d.data.size();
+    // The last strip closes the deflate stream; the others end on a byte boundary.
+    int ret = deflate(&zs, index == strips - 1 ? Z_FINISH : Z_SYNC_FLUSH);
+    if ((ret != Z_STREAM_END && ret != Z_OK) || zs.avail_in != 0) { std::cerr << "deflate failed\n"; exit(1); }
+    d.data.resize(zs.total_out);
+    deflateEnd(&zs);
+
+    std::lock_guard<std::mutex> guard(lock);
+    pending[index] = std::move(d);
+    for (auto it = pending.find(next); it != pending.end(); it = pending.find(next)) {
+        chunk("IDAT", it->second.data.data(), it->second.data.size());
+        adler = next == 0 ? it->second.adler : adler32_combine(adler, it->second.adler, it->second.raw);
+        pending.erase(it);
+        next++;
+    }
+}
+
+bool PngWriter::close() {
+    if (next != strips) { std::cerr << "PNG closed after " << next << " of " << strips << " strips\n"; exit(1); }
+    uint8_t trailer[4];
+    put_u32(trailer, adler);
+    chunk("IDAT", trailer, 4);
+    chunk("IEND", nullptr, 0);
+    out.close();
+    return !out.fail();
+}
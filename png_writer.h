@@ -0,0 +1,39 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Streaming 8-bit PNG encoder for large previews. The image is split into strips of
+// `strip_rows` rows; each strip is filtered and deflated on its own (raw deflate ended
+// by a sync flush, so the strips concatenate into one zlib stream with their adler32s
+// combined) and goes to disk as soon as every strip before it has. Strips may be
+// handed in from any thread in any order, and only out-of-order compressed strips are
+// held in memory.
+struct PngWriter {
+    PngWriter(const std::string& fname, int width, int height, int channels, int strip_rows, int level = 1);
+    // Rows [index*strip_rows, ...) of the image, `channels` bytes per pixel, tightly packed.
+    void strip(int index, const uint8_t* pixels);
+    // Writes the stream trailer once all strips are in; false on a write error.
+    bool close();
+
+    struct Deflated {
+        std::vector<uint8_t> data;
+        uint32_t adler;
+        size_t raw;
+    };
+    void chunk(const char* type, const uint8_t* data, size_t n);
+
+    std::ofstream out;
+    int width, height, channels, strip_rows, strips, level;
+    std::mutex lock;
+    std::map<int, Deflated> pending;
+    int next = 0;
+    uint32_t adler = 1;
+};
+
+#endif
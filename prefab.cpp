@@ -0,0 +1,108 @@
+#include "prefab.h"
+#include <algorithm>
+#include <sstream>
+
+Prefab Prefab::load(const std::string& fname) {
+    std::ifstream in(fname);
+    if (!in) { std::cerr << "Cannot open " << fname << "\n"; exit(1); }
+    Prefab p;
+    p.palette.push_back(nullptr);
+    uint8_t index[256] = {};
+    bool known[256] = {};
+    known['.'] = true;
+    int layer = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream ss(line);
+        std::string cmd;
+        if (!(ss >> cmd)) continue;
+        if (cmd == "size") {
+            ss >> p.sx >> p.sy >> p.sz;
+            if (p.sx <= 0 || p.sy <= 0 || p.sz <= 0 || p.sy > 256) { std::cerr << "Bad prefab size in " << fname << "\n"; exit(1); }
+            p.cells.assign((p.sy + 15) / 16 * 16 * p.sz * p.sx, 0);
+        } else if (cmd == "block") {
+            std::string c, id;
+            ss >> c >> id;
+            auto b = block::find(id);
+            if (c.size() != 1 || (!b && id != "air")) { std::cerr << "Bad prefab block " << c << " " << id << " in " << fname << "\n"; exit(1); }
+            if (p.palette.size() == 256) { std::cerr << "Too many prefab blocks in " << fname << "\n"; exit(1); }
+            index[(uint8_t)c[0]] = p.palette.size();
+            known[(uint8_t)c[0]] = true;
+            p.palette.push_back(b.get());
+        } else if (cmd == "layer") {
+            if (p.cells.empty() || layer >= p.sy) { std::cerr << "Unexpected prefab layer in " << fname << "\n"; exit(1); }
+            for (int z = 0; z < p.sz; z++) {
+                if (!std::getline(in, line) || (int)line.size() < p.sx) { std::cerr << "Short prefab layer in " << fname << "\n"; exit(1); }
+                for (int x = 0; x < p.sx; x++) {
+                    uint8_t c = line[x];
+                    if (!known[c]) { std::cerr << "Unknown prefab block '" << line[x] << "' in " << fname << "\n"; exit(1); }
+                    p.cells[(layer*p.sz + z)*p.sx + x] = index[c];
+                }
+            }
+            layer++;
+        } else {
+            std::cerr << "Unknown prefab line " << cmd << " in " << fname << "\n"; exit(1);
+        }
+    }
+    if (layer != p.sy) { std::cerr << "Prefab " << fname << " has " << layer << " of " << p.sy << " layers\n"; exit(1); }
+    p.computeSolid();
+    return p;
+}
+
+void Prefab::computeSolid() {
+    solid.assign(sy * sz, 1);
+    for (int r = 0; r < sy * sz; r++) {
+        const uint8_t* row = &cells[r * sx];
+        solid[r] = std::find(row, row + sx, 0) == row + sx;
+    }
+}
+
+Prefab Prefab::transformed(int rotation, bool mirror) const {
+    Prefab t = *this;
+    rotation &= 3;
+    if (rotation & 1) std::swap(t.sx, t.sz);
+    for (int y = 0; y < sy; y++) {
+        for (int z = 0; z < sz; z++) {
+            for (int x = 0; x < sx; x++) {
+                int mx = mirror ? sx - 1 - x : x, nx = mx, nz = z;
+                if (rotation == 1) { nx = sz - 1 - z; nz = mx; }
+                else if (rotation == 2) { nx = sx - 1 - mx; nz = sz - 1 - z; }
+                else if (rotation == 3) { nx = z; nz = sx - 1 - mx; }
+                t.cells[(y*t.sz + nz)*t.sx + nx] = cells[(y*sz + z)*sx + x];
+            }
+        }
+    }
+    t.computeSolid();
+    return t;
+}
+
+void Prefab::stamp(World& world, int x, int y, int z, const std::vector<const Block*>* remap) const {
+    const std::vector<const Block*>& pal = remap ? *remap : palette;
+    Block* lut[256];
+    for (size_t i = 0; i < pal.size(); i++) lut[i] = const_cast<Block*>(pal[i]);
+    int y0 = std::max(y, 0), y1 = std::min(y + sy, 256);
+
+    // Chunk by chunk, then one contiguous x row per (y, z) within the chunk.
+    for (int cz = z >> 4; cz <= (z + sz - 1) >> 4; cz++) {
+        for (int cx = x >> 4; cx <= (x + sx - 1) >> 4; cx++) {
+            Chunk* chunk = world.chunk(cx, cz);
+            int x0 = std::max(x, cx*16), x1 = std::min(x + sx, cx*16 + 16), n = x1 - x0;
+            int z0 = std::max(z, cz*16), z1 = std::min(z + sz, cz*16 + 16);
+            for (int wy = y0; wy < y1; wy++) {
+                Section*& sec = chunk->sections[wy >> 4];
+                if (!sec) sec = new Section(wy >> 4);
+                for (int wz = z0; wz < z1; wz++) {
+                    int r = (wy - y)*sz + (wz - z);
+                    const uint8_t* src = &cells[r*sx + (x0 - x)];
+                    Block** dst = &sec->blocks[(wy & 15)*256 + (wz & 15)*16 + (x0 & 15)];
+                    if (solid[r]) {
+                        for (int i = 0; i < n; i++) dst[i] = lut[src[i]];
+                    } else {
+                        for (int i = 0; i < n; i++) dst[i] = src[i] ? lut[src[i]] : dst[i];
+                    }
+                }
+            }
+        }
+    }
+}
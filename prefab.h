@@ -0,0 +1,34 @@
+#ifndef PREFAB_H
+#define PREFAB_H
+
+#include "mca_generator.h"
+#include <string>
+#include <vector>
+
+// A structure template loaded once and stamped many times. Cells are palette indices
+// in the same YZX order as Section, padded to whole 16-level slices, so stamping is a
+// row copy per (y, z) through a palette-to-Block* table. Index 0 keeps the block that
+// is already there; a palette entry of null writes air.
+//
+// Text format ('#' starts a comment):
+//   size <x> <y> <z>
+//   block <char> <block id>      ('.' is predefined as keep)
+//   layer                        then <z> lines of <x> chars, bottom layer first
+struct Prefab {
+    int sx = 0, sy = 0, sz = 0;
+    std::vector<const Block*> palette;
+    std::vector<uint8_t> cells;  // (y*sz + z)*sx + x
+    std::vector<uint8_t> solid;  // per row y*sz + z: 1 if it has no keep cells
+
+    static Prefab load(const std::string& fname);
+    // Quarter turns clockwise seen from above, after mirroring x if requested.
+    Prefab transformed(int rotation, bool mirror) const;
+    // Writes the prefab with its minimum corner at (x, y, z), clipped to y 0..255.
+    // remap, if given, replaces the palette (same size and index 0 meaning).
+    void stamp(World& world, int x, int y, int z, const std::vector<const Block*>* remap = nullptr) const;
+
+private:
+    void computeSolid();
+};
+
+#endif
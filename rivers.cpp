@@ -0,0 +1,210 @@
+#include "rivers.h"
+#include "parallel.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <queue>
+#include <utility>
+
+static const int kDx[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+static const int kDz[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+static const float kEps = 1e-3f; // minimum drop across filled flats, blocks
+
+void RiverNetwork::build(std::vector<float> heights, int w_, int h_, int sea_level, const RiverParams& p, int threads) {
+    w = w_; h = h_; params = p;
+    surface = std::move(heights);
+    const int n = w*h;
+    dir.assign(n, -1);
+    flow.assign(n, 1.0f);
+
+    // Priority-flood from the sea and the border: each cell popped raises its unvisited
+    // neighbours to at least its own height plus kEps, so every land cell ends up with
+    // a strictly lower neighbour. Only seeds next to land are queued, and cells raised
+    // into a depression go to a FIFO pit queue that is drained before the heap (Barnes'
+    // Priority-Flood+ε), so the heap holds little more than the flood front. The fill
+    // stays serial: it runs once on the coarse grid, 1/step² of the world's columns.
+    using Item = std::pair<float, int>;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+    std::queue<int> pit;
+    std::vector<uint8_t> seen(n, 0);
+    for (int z = 0; z < h; z++) {
+        for (int x = 0; x < w; x++) {
+            int i = z*w + x;
+            seen[i] = surface[i] <= sea_level || x == 0 || z == 0 || x == w - 1 || z == h - 1;
+        }
+    }
+    for (int z = 0; z < h; z++) {
+        for (int x = 0; x < w; x++) {
+            int i = z*w + x;
+            bool front = false;
+            for (int d = 0; d < 8 && seen[i] && !front; d++) {
+                int nx = x + kDx[d], nz = z + kDz[d];
+                front = nx >= 0 && nz >= 0 && nx < w && nz < h && !seen[nz*w + nx];
+            }
+            if (front) open.push({surface[i], i});
+        }
+    }
+    while (!open.empty() || !pit.empty()) {
+        int i;
+        if (!pit.empty()) {
+            i = pit.front();
+            pit.pop();
+        } else {
+            i = open.top().second;
+            open.pop();
+        }
+        float s = surface[i];
+        int x = i % w, z = i / w;
+        for (int d = 0; d < 8; d++) {
+            int nx = x + kDx[d], nz = z + kDz[d];
+            if (nx < 0 || nz < 0 || nx >= w || nz >= h) continue;
+            int j = nz*w + nx;
+            if (seen[j]) continue;
+            seen[j] = 1;
+            if (surface[j] <= s + kEps) {
+                surface[j] = s + kEps;
+                pit.push(j);
+            } else {
+                open.push({surface[j], j});
+            }
+        }
+    }
+
+    // D8 steepest descent; outlets keep -1.
+    parallelFor(h, threads, [&](int z, int) {
+        for (int x = 1; z > 0 && z < h - 1 && x < w - 1; x++) {
+            int i = z*w + x;
+            if (surface[i] <= sea_level) continue;
+            float best = 0.0f;
+            for (int d = 0; d < 8; d++) {
+                float drop = (surface[i] - surface[i + kDz[d]*w + kDx[d]]) * (d & 1 ? 0.70710678f : 1.0f);
+                if (drop > best) { best = drop; dir[i] = d; }
+            }
+        }
+    });
+
+    // Flow accumulation: every tile accumulates its own cells, and for each boundary
+    // cell records where its flow next reaches a boundary cell (link) or leaves the tile
+    // (cross). The boundary graph is small and is solved serially for the flow entering
+    // each tile from outside, which the tiles then add along their downstream paths.
+    const int T = std::max(2, p.tile);
+    const int tiles_x = (w + T - 1) / T, tiles_z = (h + T - 1) / T;
+    auto receiver = [&](int i) { return dir[i] < 0 ? -1 : i + kDz[dir[i]]*w + kDx[dir[i]]; };
+    auto tile_of = [&](int i) { return (i / w / T)*tiles_x + (i % w) / T; };
+    auto boundary = [&](int i) {
+        int x = i % w, z = i / w, lx = x % T, lz = z % T;
+        return lx == 0 || lz == 0 || lx == T - 1 || lz == T - 1 || x == w - 1 || z == h - 1;
+    };
+    std::vector<int> link(n, -1);
+    std::vector<uint8_t> cross(n, 0);
+    std::vector<std::vector<int>> edges(tiles_x * tiles_z);
+    std::vector<std::vector<int>> indeg(threads);
+    parallelFor(tiles_x * tiles_z, threads, [&](int t, int worker) {
+        int x0 = (t % tiles_x)*T, z0 = (t / tiles_x)*T;
+        int x1 = std::min(x0 + T, w), z1 = std::min(z0 + T, h), tw = x1 - x0;
+        std::vector<int>& deg = indeg[worker];
+        deg.assign(T*T, 0);
+        auto local = [&](int i) { return (i / w - z0)*tw + (i % w - x0); };
+        for (int z = z0; z < z1; z++) {
+            for (int x = x0; x < x1; x++) {
+                int r = receiver(z*w + x);
+                if (r >= 0 && tile_of(r) == t) deg[local(r)]++;
+            }
+        }
+        std::vector<int> ready;
+        for (int z = z0; z < z1; z++)
+            for (int x = x0; x < x1; x++)
+                if (deg[local(z*w + x)] == 0) ready.push_back(z*w + x);
+        while (!ready.empty()) {
+            int i = ready.back();
+            ready.pop_back();
+            int r = receiver(i);
+            if (r < 0 || tile_of(r) != t) continue;
+            flow[r] += flow[i];
+            if (--deg[local(r)] == 0) ready.push_back(r);
+        }
+        for (int z = z0; z < z1; z++) {
+            for (int x = x0; x < x1; x++) {
+                int i = z*w + x;
+                if (!boundary(i)) continue;
+                edges[t].push_back(i);
+                for (int c = i, r; (r = receiver(c)) >= 0; c = r) {
+                    if (tile_of(r) != t) { link[i] = r; cross[i] = 1; break; }
+                    if (boundary(r)) { link[i] = r; break; }
+                }
+            }
+        }
+    });
+
+    // inflow: flow entering a boundary cell directly from another tile; through: all
+    // outside flow passing through it.
+    std::vector<float> inflow(n, 0.0f), through(n, 0.0f);
+    std::vector<int> pending(n, 0), ready;
+    for (const auto& cells : edges)
+        for (int i : cells)
+            if (link[i] >= 0) pending[link[i]]++;
+    for (const auto& cells : edges)
+        for (int i : cells)
+            if (pending[i] == 0) ready.push_back(i);
+    while (!ready.empty()) {
+        int i = ready.back();
+        ready.pop_back();
+        int r = link[i];
+        if (r < 0) continue;
+        if (cross[i]) {
+            inflow[r] += flow[i] + through[i];
+            through[r] += flow[i] + through[i];
+        } else {
+            through[r] += through[i];
+        }
+        if (--pending[r] == 0) ready.push_back(r);
+    }
+
+    parallelFor(tiles_x * tiles_z, threads, [&](int t, int) {
+        for (int i : edges[t]) {
+            if (inflow[i] == 0.0f) continue;
+            for (int c = i; c >= 0 && tile_of(c) == t; c = receiver(c)) flow[c] += inflow[i];
+        }
+    });
+}
+
+void RiverNetwork::carve(int cx, int cz, int* heights, int* water) const {
+    const int s = params.step;
+    const float reach = params.max_width + s;
+    int i0 = std::max(0, (int)std::floor((cx*16 - reach) / s)), i1 = std::min(w - 1, (int)((cx*16 + 16 + reach) / s));
+    int j0 = std::max(0, (int)std::floor((cz*16 - reach) / s)), j1 = std::min(h - 1, (int)((cz*16 + 16 + reach) / s));
+    int level[256], bed[256];
+    std::fill(level, level + 256, INT_MAX);
+    std::fill(bed, bed + 256, INT_MAX);
+
+    // Each river cell is a segment to its receiver; columns within the half-width get
+    // the segment's interpolated water surface and a bed that deepens to the centre.
+    for (int j = j0; j <= j1; j++) {
+        for (int i = i0; i <= i1; i++) {
+            int a = j*w + i;
+            if (dir[a] < 0 || flow[a] < params.threshold) continue;
+            int b = a + kDz[dir[a]]*w + kDx[dir[a]];
+            float ax = i*s + s*0.5f, az = j*s + s*0.5f;
+            float dx = kDx[dir[a]]*s, dz = kDz[dir[a]]*s, len2 = dx*dx + dz*dz;
+            float hw = std::min(params.max_width, params.width * std::sqrt(flow[a] / params.threshold));
+            for (int lz = 0; lz < 16; lz++) {
+                for (int lx = 0; lx < 16; lx++) {
+                    float px = cx*16 + lx + 0.5f - ax, pz = cz*16 + lz + 0.5f - az;
+                    float t = std::min(1.0f, std::max(0.0f, (px*dx + pz*dz) / len2));
+                    float ex = px - t*dx, ez = pz - t*dz, d2 = ex*ex + ez*ez;
+                    if (d2 > hw*hw) continue;
+                    int c = lz*16 + lx;
+                    int wl = std::min((int)(surface[a] + (surface[b] - surface[a])*t), heights[c] - 1);
+                    int deep = std::max(1, (int)std::lround(params.depth * (1.0f - d2 / (hw*hw))));
+                    level[c] = std::min(level[c], wl);
+                    bed[c] = std::min(bed[c], wl - deep);
+                }
+            }
+        }
+    }
+    for (int c = 0; c < 256; c++) {
+        if (level[c] == INT_MAX) continue;
+        water[c] = std::max(water[c], level[c]);
+        heights[c] = std::min(heights[c], std::min(bed[c], water[c] - 1));
+    }
+}
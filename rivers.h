@@ -0,0 +1,36 @@
+#ifndef RIVERS_H
+#define RIVERS_H
+
+#include <cstdint>
+#include <vector>
+
+struct RiverParams {
+    int step = 4;             // blocks per cell of the river grid
+    int tile = 64;            // accumulation tile size in grid cells
+    float threshold = 48.0f;  // upstream grid cells before a cell carries a river
+    float width = 1.5f;       // channel half-width in blocks at the threshold, grows with sqrt(flow)
+    float max_width = 6.0f;
+    int depth = 3;            // blocks below the water surface in the channel centre
+};
+
+// Drainage on a coarse grid over the world: depressions are filled by priority-flood,
+// every cell drains to its steepest D8 neighbour and flow is accumulated per tile
+// with the tiles' boundary flows merged in a small serial pass. Only the coarse grid
+// is kept, so memory is a 1/step² fraction of the world.
+struct RiverNetwork {
+    int w = 0, h = 0;
+    RiverParams params;
+    std::vector<float> surface; // filled heights, blocks
+    std::vector<int8_t> dir;    // D8 direction (kDx/kDz index) or -1 at outlets
+    std::vector<float> flow;    // upstream cells including the cell itself
+
+    // heights: w×h grid (row-major, blocks) sampled at block (i*step + step/2, j*step + step/2).
+    // Cells at or below sea level and the grid border are outlets.
+    void build(std::vector<float> heights, int w, int h, int sea_level, const RiverParams& p, int threads);
+
+    // Lowers the 16×16 heights of chunk (cx, cz) along river channels and raises
+    // water (per column water surface, z*16 + x) to the river level there.
+    void carve(int cx, int cz, int* heights, int* water) const;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <array>
+#include <cstdint>
+
+// Philox4x32-10 counter-based generator: the output is a pure function of
+// (key, counter), so any draw can be reproduced without replaying a sequence.
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> ctr, std::array<uint32_t, 2> key) {
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)0xD2511F53u * ctr[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * ctr[2];
+        ctr = {(uint32_t)(p1 >> 32) ^ ctr[1] ^ key[0], (uint32_t)p1,
+               (uint32_t)(p0 >> 32) ^ ctr[3] ^ key[1], (uint32_t)p0};
+        key[0] += 0x9E3779B9u;
+        key[1] += 0xBB67AE85u;
+    }
+    return ctr;
+}
+
+// Random stream keyed on (seed, chunk, feature). Draw n comes from counter
+// (cx, cz, feature, n/4), so streams of different chunks or features never
+// depend on each other or on the order they are generated in.
+struct ChunkRng {
+    std::array<uint32_t, 2> key;
+    std::array<uint32_t, 4> ctr;
+    std::array<uint32_t, 4> buf;
+    int pos = 4;
+
+    ChunkRng(uint64_t seed, int cx, int cz, uint32_t feature, uint32_t index = 0)
+        : key{(uint32_t)seed, (uint32_t)(seed >> 32)}, ctr{(uint32_t)cx, (uint32_t)cz, feature, index} {}
+
+    uint32_t next() {
+        if (pos == 4) { buf = philox4x32(ctr, key); ctr[3]++; pos = 0; }
+        return buf[pos++];
+    }
+    // Uniform in [lo, hi].
+    int range(int lo, int hi) { return lo + (int)(((uint64_t)next() * (uint64_t)(hi - lo + 1)) >> 32); }
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+#endif
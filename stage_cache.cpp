@@ -0,0 +1,116 @@
+#include "stage_cache.h"
+#include <cstring>
+#include <filesystem>
+
+static const uint32_t kMagic = 0x3253434D; // "MCS2"
+
+uint64_t stageKey(uint64_t prev, const std::string& params) {
+    uint64_t h = 0xCBF29CE484222325ULL ^ prev; // FNV-1a
+    for (unsigned char c : params) { h ^= c; h *= 0x100000001B3ULL; }
+    return h;
+}
+
+std::string StageCache::path(ChunkStatus stage, int cx, int cz) const {
+    return dir + "/" + statusName(stage) + "/c." + std::to_string(cx) + "." + std::to_string(cz) + ".bin";
+}
+
+ChunkStatus StageCache::latest(const uint64_t* keys, ChunkStatus first, ChunkStatus last, int cx, int cz) const {
+    if (dir.empty()) return ChunkStatus::empty;
+    for (int s = (int)last; s >= (int)first; s--) {
+        std::ifstream in(path((ChunkStatus)s, cx, cz), std::ios::binary);
+        uint32_t magic = 0;
+        uint64_t key = 0;
+        in.read(reinterpret_cast<char*>(&magic), 4);
+        in.read(reinterpret_cast<char*>(&key), 8);
+        if (in && magic == kMagic && key == keys[s]) return (ChunkStatus)s;
+    }
+    return ChunkStatus::empty;
+}
+
+void StageCache::save(ChunkStatus stage, uint64_t key, int cx, int cz, const StageState& state) const {
+    std::vector<uint8_t> data;
+    auto put = [&](const void* p, size_t n) { data.insert(data.end(), (const uint8_t*)p, (const uint8_t*)p + n); };
+    auto put_u32 = [&](uint32_t v) { put(&v, 4); };
+    auto put_str = [&](const std::string& s) { put_u32(s.size()); put(s.data(), s.size()); };
+
+    put_u32(kMagic); put(&key, 8);
+    put(state.heights, sizeof(state.heights));
+    put(state.biome_offsets, sizeof(state.biome_offsets));
+    put(state.water, sizeof(state.water));
+    put_u32(state.tile.palette.size());
+    for (size_t i = 1; i < state.tile.palette.size(); i++) put_str(state.tile.palette[i]->name());
+    uint32_t topY = state.tile.topY;
+    put_u32(topY);
+    uLongf compSize = compressBound(state.tile.cells.size());
+    std::vector<uint8_t> comp(compSize);
+    if (compress2(comp.data(), &compSize, state.tile.cells.data(), state.tile.cells.size(), Z_BEST_SPEED) != Z_OK) {
+        std::cerr << "ZLIB compress failed\n"; exit(1);
+    }
+    put_u32(compSize); put(comp.data(), compSize);
+    for (const auto& list : state.decor.neighbours) {
+        put_u32(list.size());
+        for (const BorderWrite& w : list) {
+            put(&w.x, 4); put(&w.y, 4); put(&w.z, 4);
+            put_str(w.block->name());
+            uint8_t r = w.replace_leaves; put(&r, 1);
+        }
+    }
+
+    std::string fname = path(stage, cx, cz);
+    std::filesystem::create_directories(std::filesystem::path(fname).parent_path());
+    std::ofstream fout(fname + ".tmp", std::ios::binary);
+    fout.write(reinterpret_cast<char*>(data.data()), data.size());
+    fout.close();
+    std::filesystem::rename(fname + ".tmp", fname); // never leave a half-written snapshot
+}
+
+bool StageCache::load(ChunkStatus stage, uint64_t key, int cx, int cz, StageState& state) const {
+    std::ifstream in(path(stage, cx, cz), std::ios::binary);
+    if (!in) return false;
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t pos = 0;
+    bool ok = true;
+    auto get = [&](void* p, size_t n) {
+        if (pos + n > data.size()) { ok = false; return; }
+        std::memcpy(p, data.data() + pos, n); pos += n;
+    };
+    auto get_u32 = [&]() { uint32_t v = 0; get(&v, 4); return v; };
+    auto get_block = [&]() -> const Block* {
+        uint32_t n = get_u32();
+        if (!ok || pos + n > data.size()) { ok = false; return nullptr; }
+        std::string name(data.begin() + pos, data.begin() + pos + n); pos += n;
+        auto b = block::find(name);
+        if (!b) ok = false;
+        return b.get();
+    };
+
+    uint64_t k = 0;
+    if (get_u32() != kMagic) return false;
+    get(&k, 8);
+    if (!ok || k != key) return false;
+    get(state.heights, sizeof(state.heights));
+    get(state.biome_offsets, sizeof(state.biome_offsets));
+    get(state.water, sizeof(state.water));
+    state.tile.palette.assign(1, nullptr);
+    uint32_t palSize = get_u32();
+    for (uint32_t i = 1; i < palSize && ok; i++) state.tile.palette.push_back(get_block());
+    state.tile.topY = (int)get_u32();
+    uLongf size = state.tile.cells.size();
+    uint32_t compSize = get_u32();
+    if (!ok || pos + compSize > data.size()) return false;
+    if (uncompress(state.tile.cells.data(), &size, data.data() + pos, compSize) != Z_OK) return false;
+    pos += compSize;
+    for (auto& list : state.decor.neighbours) {
+        list.clear();
+        uint32_t n = get_u32();
+        for (uint32_t i = 0; i < n && ok; i++) {
+            BorderWrite w;
+            get(&w.x, 4); get(&w.y, 4); get(&w.z, 4);
+            w.block = get_block();
+            uint8_t r = 0; get(&r, 1);
+            w.replace_leaves = r;
+            list.push_back(w);
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,35 @@
+#ifndef STAGE_CACHE_H
+#define STAGE_CACHE_H
+
+#include "mca_generator.h"
+#include "decoration.h"
+#include <string>
+
+// Hash of a stage's parameters chained onto the key of the stage before it, so
+// changing one stage invalidates it and every later stage but nothing earlier.
+uint64_t stageKey(uint64_t prev, const std::string& params);
+
+// What a chunk looks like after a cached stage.
+struct StageState {
+    ChunkTile tile;
+    int heights[256];        // surface heights, z*16 + x
+    int biome_offsets[256];
+    int water[256];          // water surface per column (sea level or a river)
+    DecorationBuffer decor;  // outgoing cross-chunk writes (features stage)
+};
+
+// On-disk snapshots of per-chunk generation stages: dir/<stage>/c.<cx>.<cz>.bin,
+// each tagged with the stage key it was produced under. A rerun loads the latest
+// stage whose key still matches and continues from there.
+struct StageCache {
+    std::string dir; // empty = disabled
+
+    // Latest stage in [first, last] with a snapshot for keys[stage], or ChunkStatus::empty.
+    ChunkStatus latest(const uint64_t* keys, ChunkStatus first, ChunkStatus last, int cx, int cz) const;
+    bool load(ChunkStatus stage, uint64_t key, int cx, int cz, StageState& state) const;
+    void save(ChunkStatus stage, uint64_t key, int cx, int cz, const StageState& state) const;
+
+    std::string path(ChunkStatus stage, int cx, int cz) const;
+};
+
+#endif
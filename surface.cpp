@@ -0,0 +1,55 @@
+#include "surface.h"
+#include <sstream>
+
+SurfaceRules SurfaceRules::defaults(int sea_level, int forrest_line) {
+    SurfaceRules s;
+    s.fill = block::stone.get();
+    s.fluid = block::water.get();
+    SurfaceRule sand{block::sand.get(), block::sand.get()};
+    SurfaceRule grass{block::grass_block.get(), block::dirt.get()};
+    grass.min = sea_level; grass.min_biome = 4;
+    SurfaceRule rock{block::stone.get(), block::stone.get()};
+    rock.min = forrest_line; rock.min_biome = 10;
+    s.rules = {sand, grass, rock};
+    return s;
+}
+
+void SurfaceRules::parse(const std::string& spec) {
+    std::istringstream all(spec);
+    std::string item;
+    while (std::getline(all, item, ';')) {
+        std::istringstream in(item);
+        std::string top, under;
+        SurfaceRule r{nullptr, nullptr};
+        if (!(in >> top)) continue;
+        if (!(in >> under >> r.depth >> r.min >> r.min_biome)) {
+            std::cerr << "Bad surface rule: " << item << "\n"; exit(1);
+        }
+        in >> r.max >> r.max_biome;
+        auto t = block::find(top), u = block::find(under);
+        if (!t || !u) { std::cerr << "Unknown block in surface rule: " << item << "\n"; exit(1); }
+        r.top = t.get();
+        r.under = u.get();
+        rules.push_back(r);
+    }
+}
+
+void SurfaceRules::classify(const int* heights, const int* biome_offsets, int sea_level, Run* runs) const {
+    int sel[256] = {};
+    for (int r = 1; r < (int)rules.size(); r++) {
+        const SurfaceRule& rule = rules[r];
+        for (int i = 0; i < 256; i++) {
+            int h = heights[i], b = biome_offsets[i];
+            int match = (h > rule.min + b * rule.min_biome) & (h <= rule.max + b * rule.max_biome);
+            sel[i] = match ? r : sel[i];
+        }
+    }
+    for (int i = 0; i < 256; i++) {
+        const SurfaceRule& rule = rules[sel[i]];
+        int h = heights[i];
+        runs[i*4 + 0] = {fill, h - 1 - rule.depth};
+        runs[i*4 + 1] = {rule.under, h - 1};
+        runs[i*4 + 2] = {rule.top, h};
+        runs[i*4 + 3] = {fluid, sea_level};
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef SURFACE_H
+#define SURFACE_H
+
+#include "mca_generator.h"
+#include <string>
+#include <vector>
+
+// One surface rule. It matches columns where
+//   height > min + biome_offset*min_biome  and  height <= max + biome_offset*max_biome,
+// and gives them `top` at the surface over `depth` blocks of `under`.
+struct SurfaceRule {
+    const Block* top;
+    const Block* under;
+    int depth = 2;
+    int min = -1000, min_biome = 0;
+    int max = 1000, max_biome = 0;
+};
+
+// Ordered rule table: rules[0] is the fallback, later matching rules win. classify()
+// evaluates every rule over all columns of a tile with compares and selects only, so
+// adding rules costs a vectorized pass each instead of per-column branches.
+struct SurfaceRules {
+    std::vector<SurfaceRule> rules;
+    const Block* fill;  // below the surface layers
+    const Block* fluid; // from the surface up to sea level
+
+    // The original terrain: sand, grass/dirt above the shore, stone above the forest line.
+    static SurfaceRules defaults(int sea_level, int forrest_line);
+    // Appends rules from "top under depth min min_biome [max max_biome]; ..." (block ids).
+    void parse(const std::string& spec);
+    // Writes 4 runs per column (fill, under, top, fluid) for the 16×16 heights and
+    // biome offsets (index z*16 + x) into runs[i*4 .. i*4 + 3].
+    void classify(const int* heights, const int* biome_offsets, int sea_level, Run* runs) const;
+};
+
+#endif
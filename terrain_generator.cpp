@@ -1,96 +1,579 @@
 #include "mca_generator.h"
+#include "noise.h"
+#include "density.h"
+#include "caves.h"
+#include "biome_layer.h"
+#include "surface.h"
+#include "ores.h"
+#include "decoration.h"
+#include "parallel.h"
+#include "stage_cache.h"
+#include "erosion.h"
+#include "rivers.h"
+#include "prefab.h"
+#include "map_render.h"
+#include "png_writer.h"
+#include "tiles.h"
+#include "noise_cache.h"
+#include "heightmap_import.h"
+#include "rng.h"
+#include "metrics.h"
+#include "trace.h"
 #include <cmath>
 #include <algorithm>
-#include <random>
+#include <string>
+#include <filesystem>
+#include <chrono>
+#include <iomanip>
 
-float fade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
-
-float lerp(float a, float b, float t) { return a + t * (b - a); }
+int main(int argc, char** argv) {
+    const auto start = std::chrono::steady_clock::now();
+    World world;
+    bool rle = false;        // write column runs instead of single blocks
+    bool hash_noise = false; // table-free noise without the 256-block period
+    uint64_t seed = 5;
+    int coarse = 1;          // noise lattice spacing in blocks, 1 = every column
+    bool cubic = false;      // bicubic instead of bilinear coarse interpolation
+    float max_error = 1.0f;  // allowed coarse height deviation in blocks, on 3×3 probe windows
+    std::string terrain_file; // density graph parameters, enables the graph path
+    bool caves = false;      // carve 3D density caves into the tile before commit
+    bool ores = false;       // place ore veins into the tile before commit
+    bool trees = false;      // decorate with trees, merging cross-chunk writes per row
+    int threads = defaultThreads();
+    std::string cache_dir;   // per-stage chunk snapshots, reruns resume from them
+    std::string noise_cache_dir; // memory-mapped heights and biomes per noise key
+    bool erosion = false;    // hydraulic erosion on the whole heightfield before filling
+    bool rivers = false;     // carve river channels from a coarse drainage network
+    std::string prefab_file; // structure stamped on the surface of random chunks
+    float prefab_chance = 0.25f;
+    std::string map_file;    // top-down PNG of the generated blocks
+    std::string tiles_dir;   // zoomable map tiles, rewritten only where they changed
+    int preview = 0;         // > 0: only write preview.png, one sample per `preview` blocks
+    float scale = 0.004f;
+    int height_limit = 32, sea_level = 53, forrest_line = 90;
+    std::string import_file; // 16-bit heightmap used instead of the height noise
+    ImportedHeights imported;
+    int import_w = 0, import_h = 0;
+    std::string metrics_file; // per-stage timings and throughput as JSON
+    std::string trace_file;   // Chrome trace of the run, needs a -DMCA_TRACE build
+    int64_t memory_limit = 0; // MiB of block storage before the run fails, 0 = none
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--rle") rle = true;
+        else if (arg == "--hash-noise") hash_noise = true;
+        else if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i]);
+        else if (arg == "--coarse" && i + 1 < argc) coarse = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--cubic") cubic = true;
+        else if (arg == "--terrain" && i + 1 < argc) terrain_file = argv[++i];
+        else if (arg == "--caves") caves = true;
+        else if (arg == "--ores") ores = true;
+        else if (arg == "--trees") trees = true;
+        else if (arg == "--threads" && i + 1 < argc) threads = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--cache" && i + 1 < argc) cache_dir = argv[++i];
+        else if (arg == "--noise-cache" && i + 1 < argc) noise_cache_dir = argv[++i];
+        else if (arg == "--erosion") erosion = true;
+        else if (arg == "--rivers") rivers = true;
+        else if (arg == "--prefab" && i + 1 < argc) prefab_file = argv[++i];
+        else if (arg == "--prefab-chance" && i + 1 < argc) prefab_chance = std::stof(argv[++i]);
+        else if (arg == "--map" && i + 1 < argc) map_file = argv[++i];
+        else if (arg == "--tiles" && i + 1 < argc) tiles_dir = argv[++i];
+        else if (arg == "--preview" && i + 1 < argc) preview = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--scale" && i + 1 < argc) scale = std::stof(argv[++i]);
+        else if (arg == "--height-limit" && i + 1 < argc) height_limit = std::stoi(argv[++i]);
+        else if (arg == "--sea-level" && i + 1 < argc) sea_level = std::stoi(argv[++i]);
+        else if (arg == "--forest-line" && i + 1 < argc) forrest_line = std::stoi(argv[++i]);
+        else if (arg == "--import" && i + 1 < argc) import_file = argv[++i];
+        else if (arg == "--import-size" && i + 2 < argc) { import_w = std::stoi(argv[++i]); import_h = std::stoi(argv[++i]); }
+        else if (arg == "--import-scale" && i + 1 < argc) imported.scale = std::stof(argv[++i]);
+        else if (arg == "--import-range" && i + 2 < argc) { imported.lo = std::stof(argv[++i]); imported.hi = std::stof(argv[++i]); }
+        else if (arg == "--metrics" && i + 1 < argc) metrics_file = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc) trace_file = argv[++i];
+        else if (arg == "--memory-limit" && i + 1 < argc) memory_limit = std::stoll(argv[++i]);
+        else if (arg == "--max-error" && i + 1 < argc) max_error = std::stof(argv[++i]);
+        else { std::cerr << "Unknown option " << arg << "\n"; return 1; }
+    }
+    // Column runs go straight into the chunks at the surface stage; the carvers,
+    // features and stage cache work on the block tile, which --rle never fills.
+    if (rle && (caves || ores || trees || !cache_dir.empty())) {
+        std::cerr << "--rle cannot be combined with --caves, --ores, --trees or --cache\n";
+        return 1;
+    }
+    // Prefab air is stamped into sections and cannot clear blocks held as column runs.
+    if (rle && !prefab_file.empty()) { std::cerr << "--rle cannot be combined with --prefab\n"; return 1; }
+    memory::setLimit(memory_limit << 20);
 
-float grad(int hash, float x, float y) {
-    int h = hash & 7;
-    float u = h < 4 ? x : y;
-    float v = h < 4 ? y : x;
-    return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f * v : 2.0f * v);
-}
+    int width = 512*2, depth = 512*2;
+    // An imported heightmap sets the world size, in whole chunks.
+    if (!import_file.empty()) {
+        imported.open(import_file, import_w, import_h);
+        width = imported.blocksX() / 16 * 16;
+        depth = imported.blocksZ() / 16 * 16;
+        if (width <= 0 || depth <= 0) { std::cerr << "Imported heightmap is smaller than a chunk\n"; return 1; }
+        std::cout << "Importing " << imported.width << "x" << imported.height << " heightmap as "
+                  << width << "x" << depth << " blocks\n";
+    }
 
-float perlin(float x, float y, int seed = 5) {
-    int xi = (int)std::floor(x) & 255;
-    int yi = (int)std::floor(y) & 255;
+    auto height_noise = [&](int x, int z) {
+        return hash_noise ? fbmHash(x * (double)scale, z * (double)scale, seed, 5) : fbm(x * scale, z * scale, 5);
+    };
+    auto biome_noise = [&](int x, int z) {
+        return hash_noise ? fbmHash(x * 0.02 + 12423, z * 0.02, seed ^ 0xB10E, 2) : fbm(x * 0.02 + 12423, z * 0.02, 2);
+    };
 
-    float xf = x - std::floor(x);
-    float yf = y - std::floor(y);
+    // Layered terrain as a density graph; constants come from the --terrain file and
+    // the defaults reproduce the plain fBm height.
+    density::Params params;
+    if (!terrain_file.empty()) params.load(terrain_file);
+    using density::Noise;
+    Noise base(params.get("height.scale", scale), params.get("height.octaves", 5), 0.0f, 0.0f, hash_noise, seed);
+    Noise warp_x(params.get("warp.scale", 0.01f), 2, 100.0f, 0.0f, hash_noise, seed + 1);
+    Noise warp_z(params.get("warp.scale", 0.01f), 2, 0.0f, 100.0f, hash_noise, seed + 2);
+    Noise ridges(params.get("ridge.scale", 0.016f), 3, 0.0f, 0.0f, hash_noise, seed + 3);
+    auto height_graph = density::clamp(
+        density::spline(density::warp(base, warp_x + -0.5f, warp_z + -0.5f, params.get("warp.amount", 0.0f)),
+                        params.points("height.spline"))
+            + ridges * params.get("ridge.amount", 0.0f),
+        params.get("height.min", -1.0f), params.get("height.max", 2.0f));
+    auto biome_graph = Noise(params.get("biome.scale", 0.02f), params.get("biome.octaves", 2), 12423.0f, 0.0f,
+                             hash_noise, seed ^ 0xB10E);
 
-    float u = fade(xf);
-    float v = fade(yf);
+    SurfaceRules surface = SurfaceRules::defaults(sea_level, forrest_line);
+    if (params.values.count("surface.rules")) surface.parse(params.values["surface.rules"]);
 
-    static uint8_t p[512];
-    static bool initialized = false;
-    if (!initialized) {
-        for (int i = 0; i < 256; i++) p[i] = i;
-        std::shuffle(p, p + 256, std::mt19937(seed));
-        for (int i = 0; i < 256; i++) p[256 + i] = p[i];
-        initialized = true;
+    // Preview: the height function and surface rules at one sample per `preview` blocks,
+    // skipping the octaves finer than the sample spacing. No chunks are generated.
+    if (preview > 0) {
+        const int pw = width / preview, ph = depth / preview;
+        const int octaves = visibleOctaves(scale, 5, preview);
+        std::vector<float> hs(pw * ph), xs(pw), zs(ph);
+        for (int i = 0; i < pw; i++) xs[i] = i*preview * scale;
+        for (int j = 0; j < ph; j++) zs[j] = j*preview * scale;
+        parallelFor(ph, threads, [&](int j, int) {
+            float* row = &hs[j*pw];
+            if (imported.enabled()) {
+                imported.sample(0, j*preview, pw, 1, preview, row);
+            } else if (!terrain_file.empty()) {
+                density::evalTile(height_graph, 0, j*preview, pw, 1, row, preview);
+            } else if (hash_noise) {
+                for (int i = 0; i < pw; i++) row[i] = fbmHash(xs[i], zs[j], seed, 5, 2.0, 0.5, octaves);
+            } else {
+                fbmGrid(xs.data(), pw, &zs[j], 1, row, 5, 2.0f, 0.5f, octaves);
+            }
+        });
+        // Check against the full-resolution heights on a sparse grid of the samples.
+        if (!imported.enabled() && terrain_file.empty()) {
+            double bias = 0.0, worst = 0.0;
+            int n = 0, step = std::max(1, std::min(pw, ph) / 64);
+            for (int j = 0; j < ph; j += step) {
+                for (int i = 0; i < pw; i += step, n++) {
+                    double d = (hs[j*pw + i] - height_noise(i*preview, j*preview)) * height_limit;
+                    bias += d;
+                    worst = std::max(worst, std::fabs(d));
+                }
+            }
+            std::cout << "Preview vs full resolution at " << n << " samples: mean " << bias / n
+                      << " blocks, max " << worst << " blocks\n";
+        }
+        MapColors colors = MapColors::defaults();
+        std::vector<uint8_t> rgb(pw * ph * 3);
+        auto block_height = [&](int i, int j) { return (int)(hs[j*pw + i] * height_limit) + 32; };
+        parallelFor(ph, threads, [&](int j, int) {
+            int heights[256], offsets[256];
+            Run runs[256 * 4];
+            for (int i0 = 0; i0 < pw; i0 += 256) {
+                for (int k = 0; k < 256; k++) {
+                    int i = std::min(i0 + k, pw - 1), x = i*preview, z = j*preview;
+                    heights[k] = block_height(i, j);
+                    offsets[k] = biome_noise(x / 4 * 4 + 3, z / 4 * 4 + 3);
+                }
+                surface.classify(heights, offsets, sea_level, runs);
+                for (int k = 0; k < 256 && i0 + k < pw; k++) {
+                    int i = i0 + k, h = heights[k];
+                    Rgb c = h < sea_level ? colors.shade(block::water.get(), sea_level, sea_level, sea_level - h - 1)
+                                          : colors.shade(runs[k*4 + 2].block, h, j > 0 ? block_height(i, j - 1) : h, 0);
+                    std::copy(c.begin(), c.end(), &rgb[(j*pw + i) * 3]);
+                }
+            }
+        });
+        PngWriter png("preview.png", pw, ph, 3, 16);
+        for (int j = 0; j < ph; j += 16) png.strip(j / 16, &rgb[j*pw*3]);
+        if (!png.close()) { std::cerr << "Failed to save preview.png\n"; return 1; }
+        std::cout << "Saved " << pw << "x" << ph << " preview (" << octaves << " octaves) to preview.png\n";
+        return 0;
     }
 
-    int aa = p[p[xi] + yi];
-    int ab = p[p[xi] + yi + 1];
-    int ba = p[p[xi + 1] + yi];
-    int bb = p[p[xi + 1] + yi + 1];
+    // Halve the coarse step until the height deviation fits the bound on a 3×3 grid of
+    // probe windows spread over the world, placed on the lattice the chunk rows use.
+    while (coarse > 1 && terrain_file.empty() && !imported.enabled()) {
+        auto blocks = [&](int x, int z) { return height_noise(x, z) * height_limit; };
+        const int probe = std::min(128, std::min(width, depth));
+        float err = 0.0f;
+        for (int j = 0; j < 3; j++) {
+            for (int i = 0; i < 3; i++) {
+                int x0 = (width - probe) * i / 2 / coarse * coarse, z0 = (depth - probe) * j / 2 / 16 * 16;
+                err = std::max(err, coarseError(blocks, x0, z0, probe, probe, coarse, cubic));
+            }
+        }
+        std::cout << "Coarse step " << coarse << ": max height deviation " << err << " blocks on 9 probe windows\n";
+        if (err <= max_error) break;
+        coarse /= 2;
+    }
 
-    float x1 = lerp(grad(aa, xf, yf), grad(ba, xf - 1, yf), u);
-    float x2 = lerp(grad(ab, xf, yf - 1), grad(bb, xf - 1, yf - 1), u);
+    // Stage keys chain onto the previous stage, so changing e.g. only the features
+    // invalidates features and later stages while noise, surface and carvers resume
+    // from the cache.
+    auto param = [&](const std::string& key) {
+        auto it = params.values.find(key);
+        return it == params.values.end() ? std::string() : it->second;
+    };
+    // The height and biome fields (what the noise cache holds) depend on these alone;
+    // the noise stage adds rivers and the sea on top.
+    std::string field_params = "seed=" + std::to_string(seed) + " hash=" + std::to_string(hash_noise) +
+        " coarse=" + std::to_string(coarse) + " cubic=" + std::to_string(cubic) + " scale=" + std::to_string(scale) +
+        " graph=" + std::to_string(!terrain_file.empty()) + " erosion=" + std::to_string(erosion);
+    if (erosion) field_params += " height_limit=" + std::to_string(height_limit);
+    if (imported.enabled()) {
+        field_params += " import=" + import_file + " mtime=" +
+            std::to_string(std::filesystem::last_write_time(import_file).time_since_epoch().count()) +
+            " import_scale=" + std::to_string(imported.scale) + " import_range=" + std::to_string(imported.lo) + ":" + std::to_string(imported.hi);
+    }
+    for (const auto& [key, value] : params.values) {
+        bool field = key.rfind("height.", 0) == 0 || key.rfind("warp.", 0) == 0 || key.rfind("ridge.", 0) == 0 ||
+                     key.rfind("biome.", 0) == 0 || (erosion && key.rfind("erosion.", 0) == 0);
+        if (field) field_params += " " + key + "=" + value;
+    }
+    std::string noise_params = field_params + " rivers=" + std::to_string(rivers) + " height_limit=" + std::to_string(height_limit) +
+        " sea_level=" + std::to_string(sea_level);
+    for (const auto& [key, value] : params.values)
+        if (rivers && key.rfind("rivers.", 0) == 0) noise_params += " " + key + "=" + value;
+    uint64_t keys[8] = {};
+    keys[(int)ChunkStatus::noise] = stageKey(0, noise_params);
+    // The forest line only moves surface rules and biome ids, not the heights.
+    keys[(int)ChunkStatus::surface] = stageKey(keys[(int)ChunkStatus::noise],
+                                               param("surface.rules") + " forrest_line=" + std::to_string(forrest_line));
+    keys[(int)ChunkStatus::carvers] = stageKey(keys[(int)ChunkStatus::surface], caves ? "caves" : "");
+    keys[(int)ChunkStatus::features] = stageKey(keys[(int)ChunkStatus::carvers],
+                                                std::string(ores ? "ores " : "") + (trees ? "trees" : ""));
+    StageCache cache;
+    cache.dir = cache_dir;
 
-    return (lerp(x1, x2, v) + 1.0f) * 0.5f; // normalize 0..1
-}
+    // Noise for one row of chunks at a time, then chunk-major so each chunk is
+    // filled in a local tile and committed once.
+    std::vector<float> heights(width * 16);
+    std::vector<float> xs(width), zs(16);
+    BiomeLayer biome_layer;
+    std::vector<StageState> states(threads);
+    CaveParams cave_params;
+    cave_params.seed = seed;
+    std::vector<OreConfig> ore_configs = defaultOres();
+    const int chunks_x = width / 16, chunks_z = depth / 16;
+    std::vector<DecorationBuffer> decor(trees ? chunks_x * chunks_z : 0);
+    auto decor_at = [&](int cx, int cz) -> const DecorationBuffer* {
+        if (cx < 0 || cx >= chunks_x || cz < 0 || cz >= chunks_z) return nullptr;
+        return &decor[cz*chunks_x + cx];
+    };
+    // Row cz is final once rows cz-1..cz+1 have been decorated: merge the writes its
+    // neighbours buffered for it, then light (left to the game) and heightmaps.
+    // Region rows are written and freed as soon as they are final, unless a pass over
+    // the whole world (prefabs, maps) still needs them. Map tiles are rendered a tile
+    // row at a time just before that.
+    const bool stream_regions = prefab_file.empty() && map_file.empty();
+    TilePyramid pyramid;
+    std::vector<uint8_t> clean; // chunks resumed whole from the stage cache
+    if (!tiles_dir.empty()) {
+        pyramid.dir = tiles_dir;
+        pyramid.begin(chunks_x, chunks_z, keys[(int)ChunkStatus::features]);
+    }
+    // Workers only flag the memory limit; the run ends here on the main thread, between
+    // chunk rows, with what each region still held.
+    auto check_memory = [&] {
+        if (!memory::overLimit()) return;
+        std::cerr << std::fixed << std::setprecision(1) << "Memory limit of " << memory_limit << " MiB exceeded (peak "
+                  << memory::peak() / 1048576.0 << " MiB), now:";
+        memory::print(std::cerr, memory::live());
+        std::cerr << "\nHeld by " << world.regions.size() << " regions:";
+        memory::print(std::cerr, world.memory());
+        std::cerr << "\n";
+        for (const auto& [pos, region] : world.regions) {
+            std::cerr << "  r." << pos.first << "." << pos.second << ":";
+            memory::print(std::cerr, region->memory());
+            std::cerr << "\n";
+        }
+        exit(1);
+    };
+    auto finish_row = [&](int cz) {
+        parallelFor(chunks_x, threads, [&](int cx, int) {
+            metrics::Scope m(metrics::finish);
+            Chunk* chunk = world.chunk(cx, cz);
+            if (trees) mergeBorderWrites(*chunk, cx, cz, decor_at);
+            chunk->status = ChunkStatus::light;
+            chunk->computeHeightmap();
+            chunk->status = ChunkStatus::full;
+        });
+        if (trees && cz > 0) for (int cx = 0; cx < chunks_x; cx++) decor[(cz-1)*chunks_x + cx].clear();
+        if (!tiles_dir.empty() && stream_regions && (cz % 16 == 15 || cz == chunks_z - 1))
+            pyramid.addRow(world, cz / 16, MapColors::defaults(), clean, threads);
+        if (stream_regions && cz % 32 == 31) world.saveRow(cz / 32);
+        check_memory();
+    };
+    // Normalized heights for the 16 block rows of chunk row cz.
+    auto compute_heights = [&](int cz, float* out) {
+        metrics::Scope m(metrics::noise, width * 16);
+        if (imported.enabled()) {
+            parallelFor(16, threads, [&](int lz, int) { imported.sample(0, cz*16 + lz, width, 1, 1, out + lz*width); });
+        } else if (!terrain_file.empty()) {
+            density::evalTile(height_graph, 0, cz*16, width, 16, out);
+        } else if (coarse > 1) {
+            sampleCoarse(height_noise, 0, cz*16, width, 16, coarse, cubic, out);
+        } else if (hash_noise) {
+            for (int lz = 0; lz < 16; lz++) {
+                for (int x = 0; x < width; x++) {
+                    out[lz*width + x] = height_noise(x, cz*16 + lz);
+                }
+            }
+        } else {
+            for (int x = 0; x < width; x++) xs[x] = x * scale;
+            for (int lz = 0; lz < 16; lz++) zs[lz] = (cz*16 + lz) * scale;
+            fbmGrid(xs.data(), width, zs.data(), 16, out, 5);
+        }
+    };
+    auto compute_biomes = [&](int cz) {
+        // Biome noise once per 4×4 quart cell.
+        metrics::Scope m(metrics::biomes, width * 16);
+        if (!terrain_file.empty()) {
+            biome_layer.resize(0, cz*16, width, 16);
+            density::evalTile(biome_graph, 3, cz*16 + 3, width / 4, 4, biome_layer.values.data(), 4);
+        } else {
+            biome_layer.evaluate(biome_noise, 0, cz*16, width, 16);
+        }
+    };
 
-float fbm(float x, float y, int octaves = 4, float lacunarity = 2.0f, float gain = 0.5f) {
-    float total = 0.0f, amplitude = 1.0f, frequency = 1.0f;
-    for (int i = 0; i < octaves; ++i) {
-        total += perlin(x * frequency, y * frequency) * amplitude;
-        amplitude *= gain;
-        frequency *= lacunarity;
+    std::vector<ChunkStatus> resume(chunks_x * chunks_z);
+    bool any_noise = false;
+    for (int i = 0; i < chunks_x * chunks_z; i++) {
+        resume[i] = cache.latest(keys, ChunkStatus::noise, ChunkStatus::features, i % chunks_x, i / chunks_x);
+        any_noise |= resume[i] == ChunkStatus::empty;
+    }
+    if (!tiles_dir.empty() && prefab_file.empty()) { // prefabs change chunks after the cache
+        clean.resize(chunks_x * chunks_z);
+        for (int i = 0; i < chunks_x * chunks_z; i++) clean[i] = resume[i] == ChunkStatus::features;
+    }
+    NoiseCache noise_cache;
+    if (!noise_cache_dir.empty() && any_noise) noise_cache.open(noise_cache_dir, stageKey(0, field_params), width, depth);
+    // Erosion runs between fBm and block filling, a band of tile rows at a time.
+    ErosionParams ep;
+    ep.iterations = params.get("erosion.iterations", ep.iterations);
+    ep.tile = params.get("erosion.tile", ep.tile);
+    ep.halo = params.get("erosion.halo", ep.halo);
+    ep.rain = params.get("erosion.rain", ep.rain);
+    ep.evaporation = params.get("erosion.evaporation", ep.evaporation);
+    ep.flow = params.get("erosion.flow", ep.flow);
+    ep.capacity = params.get("erosion.capacity", ep.capacity);
+    ep.erosion = params.get("erosion.strength", ep.erosion);
+    ep.deposition = params.get("erosion.deposition", ep.deposition);
+    ep.max_erosion = params.get("erosion.max_erosion", ep.max_erosion);
+    ep.vertical = height_limit;
+    ErosionStream eroded(width, depth, ep, threads, compute_heights);
+    // Drainage is computed once on a coarse grid sampled from the same heights.
+    RiverNetwork river_network;
+    if (rivers && any_noise) {
+        metrics::Scope m(metrics::rivers, width * depth);
+        RiverParams rp;
+        rp.step = params.get("rivers.step", rp.step);
+        rp.threshold = params.get("rivers.threshold", rp.threshold);
+        rp.width = params.get("rivers.width", rp.width);
+        rp.depth = params.get("rivers.depth", rp.depth);
+        const int s = rp.step, rw = width / s, rh = depth / s;
+        // A separate pass, so the eroded field is never held whole: the main loop
+        // erodes the bands again unless the noise cache has them.
+        ErosionStream river_eroded(width, depth, ep, threads, compute_heights);
+        std::vector<float> coarse_heights(rw * rh);
+        for (int j = 0; j < rh; j++) {
+            float* row = coarse_heights.data() + j*rw;
+            int z = j*s + s/2;
+            if (erosion) {
+                const float* src = noise_cache.complete() ? noise_cache.heights(z / 16) : river_eroded.rows(z / 16);
+                src += (z % 16)*width;
+                for (int i = 0; i < rw; i++) row[i] = src[i*s + s/2];
+            } else if (imported.enabled()) {
+                imported.sample(s/2, z, rw, 1, s, row);
+            } else if (!terrain_file.empty()) {
+                density::evalTile(height_graph, s/2, z, rw, 1, row, s);
+            } else {
+                for (int i = 0; i < rw; i++) row[i] = height_noise(i*s + s/2, z);
+            }
+            for (int i = 0; i < rw; i++) row[i] = row[i] * height_limit + 32;
+        }
+        river_network.build(std::move(coarse_heights), rw, rh, sea_level, rp, threads);
     }
-    return total / ((1.0f - std::pow(gain, octaves)) / (1.0f - gain));
-}
 
+    for (int cz = 0; cz < chunks_z; cz++) {
+        bool need_noise = false;
+        for (int cx = 0; cx < chunks_x; cx++) need_noise |= resume[cz*chunks_x + cx] == ChunkStatus::empty;
+        const float* strip = heights.data();
+        if (need_noise && noise_cache.has(cz)) {
+            strip = noise_cache.heights(cz);
+            biome_layer.resize(0, cz*16, width, 16);
+            std::copy(noise_cache.biomes(cz), noise_cache.biomes(cz) + biome_layer.values.size(), biome_layer.values.begin());
+        } else if (need_noise) {
+            if (erosion) strip = eroded.rows(cz);
+            else compute_heights(cz, heights.data());
+            compute_biomes(cz);
+            if (noise_cache.enabled()) {
+                std::copy(strip, strip + width*16, noise_cache.heights(cz));
+                std::copy(biome_layer.values.begin(), biome_layer.values.end(), noise_cache.biomes(cz));
+                noise_cache.done(cz);
+            }
+        }
+        // Chunks are created up front; the per-chunk work below only touches its own
+        // chunk and per-worker scratch, so it runs in parallel with identical output.
+        for (int cx = 0; cx < chunks_x; cx++) world.chunk(cx, cz);
+        parallelFor(chunks_x, threads, [&](int cx, int worker) {
+            StageState& st = states[worker];
+            Chunk* chunk = world.chunk(cx, cz);
+            ChunkStatus done = resume[cz*chunks_x + cx];
+            if (done != ChunkStatus::empty && !cache.load(done, keys[(int)done], cx, cz, st)) {
+                std::cerr << "Corrupt stage cache " << cache.path(done, cx, cz) << "\n"; exit(1);
+            }
+            auto finish = [&](ChunkStatus stage) {
+                chunk->status = stage;
+                if (!cache.dir.empty()) cache.save(stage, keys[(int)stage], cx, cz, st);
+            };
+            Run runs[256 * 4];
 
+            if (done < ChunkStatus::noise) {
+                metrics::Scope m(metrics::fill);
+                st.tile.clear();
+                st.decor.clear();
+                for (int lz = 0; lz < 16; lz++) {
+                    for (int lx = 0; lx < 16; lx++) {
+                        int x = cx*16 + lx, z = cz*16 + lz;
+                        float h = strip[lz*width + x];
+                        st.heights[lz*16 + lx] = (int)(h * height_limit) + 32;
+                        st.biome_offsets[lz*16 + lx] = biome_layer.at(x, z);
+                        st.water[lz*16 + lx] = sea_level;
+                    }
+                }
+                if (rivers) river_network.carve(cx, cz, st.heights, st.water);
+                for (int i = 0; i < 256 && !rle; i++) {
+                    Run base[] = {{block::stone.get(), st.heights[i]}, {block::water.get(), st.water[i]}};
+                    st.tile.setColumn(i % 16, i / 16, base, 2);
+                }
+                finish(ChunkStatus::noise);
+            }
+            int quart_biomes[16];
+            for (int q = 0; q < 16; q++) {
+                int lx = (q % 4)*4 + 3, lz = (q / 4)*4 + 3;
+                int height = st.heights[lz*16 + lx];
+                int biome_offset = st.biome_offsets[lz*16 + lx];
+                int biome = 1;
+                if (height > sea_level + biome_offset * 4) biome = 0;
+                if (height > forrest_line - 5 + biome_offset * 10) biome = 0;
+                quart_biomes[q] = biome;
+            }
+            world.setBiomes(cx, cz, quart_biomes);
 
-int main() {
-    World world;
+            if (done < ChunkStatus::surface) {
+                metrics::Scope m(metrics::surface);
+                surface.classify(st.heights, st.biome_offsets, sea_level, runs);
+                for (int i = 0; i < 256; i++) {
+                    // River beds get gravel instead of the land rules.
+                    if (st.water[i] > sea_level && st.heights[i] < st.water[i])
+                        runs[i*4 + 1].block = runs[i*4 + 2].block = block::gravel.get();
+                    runs[i*4 + 3].top = st.water[i];
+                    if (rle) {
+                        chunk->setColumn(i % 16, i / 16, runs + i*4, 4);
+                        continue;
+                    }
+                    // Under and top layers over the noise stage's stone.
+                    st.tile.setColumn(i % 16, i / 16, runs + i*4, 3);
+                }
+                finish(ChunkStatus::surface);
+            }
+            if (rle) return;
+            if (done < ChunkStatus::carvers) {
+                metrics::Scope m(metrics::carvers);
+                if (caves) carveCaves(st.tile, cx, cz, st.heights, st.water, cave_params);
+                finish(ChunkStatus::carvers);
+            }
+            if (done < ChunkStatus::features) {
+                metrics::Scope m(metrics::features);
+                if (ores) placeOres(st.tile, cx, cz, seed, ore_configs);
+                if (trees) decorateTrees(st.tile, cx, cz, st.heights, seed, st.decor);
+                finish(ChunkStatus::features);
+            }
+            if (trees) decor[cz*chunks_x + cx] = st.decor;
+            metrics::Scope m(metrics::commit);
+            chunk->commit(st.tile);
+        });
+        if (cz > 0) finish_row(cz - 1);
+    }
+    finish_row(chunks_z - 1);
 
-    const int width = 512*2, depth = 512*2, height_limit = 32;
-    const float scale = 0.004f;
-    const int sea_level = 53, forrest_line = 90;
-
-    for (int z = 0; z < depth; z++) {
-        for (int x = 0; x < width; x++) {
-            float h = fbm(x * scale, z * scale, 5);
-            int height = (int)(h * height_limit) + 32;
-            int biome_offset = fbm(x * 0.02 + 12423, z * 0.02, 2);
-
-            auto top_block = (height > sea_level + biome_offset * 4) ? block::grass_block : block::sand;
-            top_block = (height > forrest_line + biome_offset * 10) ? block::stone : top_block;
-
-            auto below_surface_block = (top_block == block::grass_block) ? block::dirt : top_block;
-            for (int y = 0; y <= std::max(height, sea_level); y++) {
-                if (y > height)
-                    world.setBlock(block::water, x, y, z);
-                else if (y == height)
-                    world.setBlock(top_block, x, y, z);
-                else if (y > height-3)
-                    world.setBlock(below_surface_block, x, y, z);
-                else
-                    world.setBlock(block::stone, x, y, z);
+    // Structures go in after all terrain so they can cross chunk borders; each chunk
+    // rolls for one at a random spot and orientation on dry surface.
+    if (!prefab_file.empty()) {
+        Prefab prefab = Prefab::load(prefab_file);
+        std::vector<Prefab> variants;
+        for (int o = 0; o < 8; o++) variants.push_back(prefab.transformed(o & 3, o >= 4));
+        int placed = 0;
+        for (int cz = 0; cz < chunks_z; cz++) {
+            for (int cx = 0; cx < chunks_x; cx++) {
+                ChunkRng rng(seed, cx, cz, 200);
+                if (rng.uniform() >= prefab_chance) continue;
+                const Prefab& v = variants[rng.range(0, 7)];
+                int lx = rng.range(0, 15), lz = rng.range(0, 15);
+                if (cx*16 + lx + v.sx > width || cz*16 + lz + v.sz > depth) continue;
+                Chunk* chunk = world.chunk(cx, cz);
+                int y = chunk->heightmap[lz*16 + lx];
+                if (y > 0 && chunk->blockAt(lx, y - 1, lz) == block::water.get()) continue;
+                v.stamp(world, cx*16 + lx, y, cz*16 + lz);
+                placed++;
             }
-            int biome = 1;
-            if (height > sea_level + biome_offset * 4) biome = 0;
-            if (height > forrest_line - 5 + biome_offset * 10) biome = 0;
-            world.setBiomeColumn(x, z, 0, 255, biome);
         }
+        parallelFor(chunks_x * chunks_z, threads, [&](int i, int) {
+            world.chunk(i % chunks_x, i / chunks_x)->computeHeightmap();
+        });
+        std::cout << "Placed " << placed << " prefabs\n";
+        check_memory();
+    }
+
+    // One chunk row per PNG strip, rendered from the world itself.
+    if (!map_file.empty()) {
+        MapColors colors = MapColors::defaults();
+        PngWriter png(map_file, width, depth, 3, 16);
+        std::vector<uint8_t> strip(width * 16 * 3);
+        for (int cz = 0; cz < chunks_z; cz++) {
+            renderMap(world, 0, cz, chunks_x, 1, colors, strip.data(), threads);
+            png.strip(cz, strip.data());
+        }
+        if (!png.close()) { std::cerr << "Failed to save " << map_file << "\n"; return 1; }
+        std::cout << "Saved map to " << map_file << "\n";
+    }
+
+    if (!tiles_dir.empty()) {
+        if (!stream_regions)
+            for (int ty = 0; ty < (chunks_z + 15) / 16; ty++) pyramid.addRow(world, ty, MapColors::defaults(), clean, threads);
+        pyramid.finish(threads);
+        std::cout << "Wrote " << pyramid.written << " tiles to " << tiles_dir << " (" << pyramid.unchanged << " unchanged, "
+                  << pyramid.rendered << " rendered)\n";
     }
 
     world.save();
+    check_memory();
     std::cout << "Saved perlin terrain\n";
+    std::cout << std::fixed << std::setprecision(1) << "Peak block memory " << memory::peak() / 1048576.0 << " MiB (peaks by kind:";
+    for (int k = 0; k < memory::kKinds; k++)
+        std::cout << " " << memory::kindName((memory::Kind)k) << " " << memory::peak((memory::Kind)k) / 1048576.0 << " MiB";
+    std::cout << ")\n";
+    if (!metrics_file.empty()) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        metrics::writeReport(metrics_file, elapsed, threads);
+        std::cout << "Wrote metrics to " << metrics_file << "\n";
+    }
+    if (!trace_file.empty()) {
+        if (!trace::enabled) std::cerr << "--trace needs a build with -DMCA_TRACE\n";
+        else { trace::dump(trace_file); std::cout << "Wrote trace to " << trace_file << "\n"; }
+    }
     return 0;
 }
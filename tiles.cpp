@@ -0,0 +1,251 @@
+#include "tiles.h"
+#include "parallel.h"
+#include "png_writer.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+static const char* kViewer = R"(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>Map</title>
+<style>html,body{margin:0;height:100%;overflow:hidden;background:#000}#map{position:absolute;inset:0;cursor:grab}
+#map img{position:absolute;width:256px;height:256px;image-rendering:pixelated}</style></head>
+<body><div id="map"></div><script>
+const MAX_ZOOM = %MAX_ZOOM%, TILE = 256, map = document.getElementById('map');
+let zoom = 0, scale = 1, cx = TILE / 2, cy = TILE / 2; // view centre in zoom-0 pixels
+function draw() {
+  const z = Math.max(0, Math.min(MAX_ZOOM, Math.round(zoom))), f = Math.pow(2, zoom), s = TILE * f / Math.pow(2, z);
+  const w = map.clientWidth, h = map.clientHeight, ox = w / 2 - cx * f, oy = h / 2 - cy * f;
+  const seen = new Set();
+  for (let y = Math.floor(-oy / s); y * s + oy < h; y++) for (let x = Math.floor(-ox / s); x * s + ox < w; x++) {
+    if (x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z)) continue;
+    const key = z + '/' + x + '/' + y; seen.add(key);
+    let img = document.getElementById(key);
+    if (!img) { img = new Image(); img.id = key; img.onerror = () => img.style.visibility = 'hidden'; img.src = key + '.png'; map.appendChild(img); }
+    img.style.transform = 'translate(' + (x * s + ox) + 'px,' + (y * s + oy) + 'px) scale(' + s / TILE + ')';
+    img.style.transformOrigin = '0 0';
+  }
+  for (const img of [...map.children]) if (!seen.has(img.id)) img.remove();
+}
+map.onwheel = e => { e.preventDefault(); zoom = Math.max(0, Math.min(MAX_ZOOM + 2, zoom - Math.sign(e.deltaY) * 0.25)); draw(); };
+map.onmousedown = e => {
+  const move = m => { const f = Math.pow(2, zoom); cx -= m.movementX / f; cy -= m.movementY / f; draw(); };
+  window.addEventListener('mousemove', move);
+  window.addEventListener('mouseup', () => window.removeEventListener('mousemove', move), {once: true});
+};
+window.onresize = draw;
+draw();
+</script></body></html>
+)";
+
+int TilePyramid::tilesAcross(int z) const {
+    int span = kTile << (max_zoom - z); // blocks covered
+    return (width + span - 1) / span;
+}
+
+std::string TilePyramid::path(int z, int x, int y) const {
+    return dir + "/" + std::to_string(z) + "/" + std::to_string(x) + "/" + std::to_string(y) + ".png";
+}
+
+void TilePyramid::begin(int chunks_x_, int chunks_z_, uint64_t key_) {
+    chunks_x = chunks_x_;
+    chunks_z = chunks_z_;
+    key = key_;
+    width = chunks_x * 16;
+    depth = chunks_z * 16;
+    max_zoom = 0;
+    while ((kTile << max_zoom) < std::max(width, depth)) max_zoom++;
+    written = unchanged = rendered = 0;
+    old_hashes.clear();
+    hashes.clear();
+    pending.assign(max_zoom + 1, {});
+    pending_y.assign(max_zoom + 1, -1);
+    north_edge.assign(tilesAcross(max_zoom) * kTile, INT16_MIN);
+    reuse = false;
+    std::ifstream manifest(dir + "/manifest.txt");
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::istringstream ss(line);
+        std::string first;
+        if (!(ss >> first)) continue;
+        uint64_t h;
+        int x, y;
+        if (first == "key") {
+            if (ss >> std::hex >> h >> std::dec >> x >> y) reuse = h == key && x == width && y == depth;
+        } else if (ss >> x >> y >> std::hex >> h) {
+            old_hashes[{std::stoi(first), x, y}] = h;
+        }
+    }
+}
+
+void TilePyramid::addRow(const World& world, int ty, const MapColors& colors, const std::vector<uint8_t>& clean, int threads) {
+    std::vector<Tile> row(tilesAcross(max_zoom));
+    parallelFor(row.size(), threads, [&](int tx, int) {
+        bool same = reuse && !clean.empty();
+        for (int cz = ty*16; same && cz < std::min(ty*16 + 16, chunks_z); cz++)
+            for (int cx = tx*16; same && cx < std::min(tx*16 + 16, chunks_x); cx++) same = clean[cz*chunks_x + cx];
+        if (same && keep(max_zoom, tx, ty)) { row[tx].clean = true; return; }
+        row[tx].rgb.assign(kTile * kTile * 3, 0);
+        renderMap(world, tx*16, ty*16, 16, 16, colors, row[tx].rgb.data(), 1, &north_edge[tx*256]);
+        rendered++;
+        store(max_zoom, tx, ty, row[tx].rgb);
+    });
+    // The chunk row above the next tile row may be written out before it is rendered.
+    for (int cx = 0; cx < chunks_x; cx++) {
+        const Chunk* chunk = world.find(cx, std::min(ty*16 + 15, chunks_z - 1));
+        for (int x = 0; x < 16; x++) north_edge[cx*16 + x] = chunk ? chunk->heightmap[15*16 + x] : INT16_MIN;
+    }
+    addLevelRow(max_zoom, ty, std::move(row), threads);
+}
+
+// Row y of zoom z is done: an even row waits for its partner, an odd one completes a
+// row of parents.
+void TilePyramid::addLevelRow(int z, int y, std::vector<Tile> row, int threads) {
+    if (z == 0) return;
+    if (y % 2 == 0) {
+        pending[z] = std::move(row);
+        pending_y[z] = y;
+        return;
+    }
+    parentRow(z - 1, y / 2, pending[z], &row, threads);
+}
+
+// Parents row y at zoom z from children rows 2y (top) and 2y+1 (bottom, null if past
+// the world).
+void TilePyramid::parentRow(int z, int y, std::vector<Tile>& top, std::vector<Tile>* bottom, int threads) {
+    std::vector<Tile> up(tilesAcross(z));
+    Tile none;
+    parallelFor(up.size(), threads, [&](int x, int) {
+        Tile* children[4];
+        for (int q = 0; q < 4; q++) {
+            std::vector<Tile>* r = q < 2 ? &top : bottom;
+            int cx = x*2 + q%2;
+            children[q] = r && cx < (int)r->size() ? &(*r)[cx] : &none;
+        }
+        up[x] = parent(z, x, y, children);
+    });
+    pending[z + 1].clear();
+    pending_y[z + 1] = -1;
+    addLevelRow(z, y, std::move(up), threads);
+}
+
+void TilePyramid::finish(int threads) {
+    for (int z = max_zoom; z > 0; z--)
+        if (pending_y[z] >= 0) parentRow(z - 1, pending_y[z] / 2, pending[z], nullptr, threads);
+
+    std::ostringstream lines;
+    lines << "key " << std::hex << key << std::dec << " " << width << " " << depth << "\n";
+    for (const auto& [k, hash] : hashes)
+        lines << std::get<0>(k) << " " << std::get<1>(k) << " " << std::get<2>(k) << " " << std::hex << hash << std::dec << "\n";
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir + "/manifest.txt.tmp") << lines.str();
+    std::filesystem::rename(dir + "/manifest.txt.tmp", dir + "/manifest.txt");
+    std::string viewer = kViewer;
+    viewer.replace(viewer.find("%MAX_ZOOM%"), 10, std::to_string(max_zoom));
+    std::ofstream(dir + "/index.html") << viewer;
+}
+
+// 2×2 average of the four tiles below (x, y) at zoom z+1, in quadrant order. Kept as
+// it is on disk if all of them are.
+TilePyramid::Tile TilePyramid::parent(int z, int x, int y, Tile* const* children) {
+    int span = kTile << (max_zoom - z);
+    if (x*span >= width || y*span >= depth) return {};
+    bool same = true;
+    for (int q = 0; q < 4; q++) same &= children[q]->clean || children[q]->rgb.empty();
+    Tile t;
+    if (same && keep(z, x, y)) { t.clean = true; return t; }
+    for (int q = 0; q < 4; q++)
+        if (children[q]->clean && children[q]->rgb.empty()) load(z + 1, x*2 + q%2, y*2 + q/2, *children[q]);
+    t.rgb.assign(kTile * kTile * 3, 0);
+    for (int q = 0; q < 4; q++) {
+        const std::vector<uint8_t>& child = children[q]->rgb;
+        if (child.empty()) continue;
+        for (int ty = 0; ty < kTile/2; ty++) {
+            for (int tx = 0; tx < kTile/2; tx++) {
+                const uint8_t* a = &child[((ty*2)*kTile + tx*2)*3];
+                uint8_t* o = &t.rgb[(((q/2)*kTile/2 + ty)*kTile + (q%2)*kTile/2 + tx)*3];
+                for (int c = 0; c < 3; c++) o[c] = (a[c] + a[3 + c] + a[kTile*3 + c] + a[kTile*3 + 3 + c] + 2) / 4;
+            }
+        }
+    }
+    store(z, x, y, t.rgb);
+    return t;
+}
+
+bool TilePyramid::keep(int z, int x, int y) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = old_hashes.find({z, x, y});
+    if (it == old_hashes.end() || !std::filesystem::exists(path(z, x, y))) return false;
+    hashes[{z, x, y}] = it->second;
+    unchanged++;
+    return true;
+}
+
+// Reads back an 8-bit RGB tile as written by store(); false if it is not one.
+static bool readTile(const std::string& path, int size, std::vector<uint8_t>& rgb) {
+    std::ifstream in(path, std::ios::binary);
+    uint8_t sig[8];
+    if (!in.read((char*)sig, 8) || memcmp(sig, "\x89PNG\r\n\x1a\n", 8) != 0) return false;
+    auto u32 = [](const uint8_t* p) { return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; };
+    std::vector<uint8_t> idat;
+    for (bool end = false; !end;) {
+        uint8_t head[8];
+        if (!in.read((char*)head, 8)) return false;
+        uint32_t n = u32(head);
+        std::vector<uint8_t> data(n + 4); // with the crc
+        if (!in.read((char*)data.data(), n + 4)) return false;
+        if (memcmp(head + 4, "IHDR", 4) == 0) {
+            if (n < 13 || (int)u32(&data[0]) != size || (int)u32(&data[4]) != size || data[8] != 8 || data[9] != 2 || data[12] != 0)
+                return false;
+        } else if (memcmp(head + 4, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), data.begin(), data.begin() + n);
+        } else if (memcmp(head + 4, "IEND", 4) == 0) {
+            end = true;
+        }
+    }
+    const int stride = size * 3;
+    std::vector<uint8_t> raw((stride + 1) * size);
+    uLongf n = raw.size();
+    if (uncompress(raw.data(), &n, idat.data(), idat.size()) != Z_OK || n != raw.size()) return false;
+    rgb.assign(stride * size, 0);
+    for (int y = 0; y < size; y++) {
+        const uint8_t* src = &raw[y*(stride + 1) + 1];
+        uint8_t* row = &rgb[y*stride];
+        const uint8_t* up = y ? row - stride : nullptr;
+        int filter = src[-1];
+        for (int i = 0; i < stride; i++) {
+            int a = i >= 3 ? row[i - 3] : 0, b = up ? up[i] : 0, c = up && i >= 3 ? up[i - 3] : 0;
+            int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            int pred = filter == 0 ? 0 : filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 :
+                       pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+            if (filter > 4) return false;
+            row[i] = src[i] + pred;
+        }
+    }
+    return true;
+}
+
+void TilePyramid::load(int z, int x, int y, Tile& tile) {
+    if (!readTile(path(z, x, y), kTile, tile.rgb)) {
+        std::cerr << "Cannot read tile " << path(z, x, y) << "; remove " << dir << "/manifest.txt to rebuild\n";
+        exit(1);
+    }
+}
+
+void TilePyramid::store(int z, int x, int y, const std::vector<uint8_t>& rgb) {
+    uint64_t hash = 14695981039346656037ull;
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(rgb.data());
+    for (size_t i = 0; i < rgb.size() / 8; i++) hash = (hash ^ words[i]) * 1099511628211ull;
+    std::string file = path(z, x, y);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        hashes[{z, x, y}] = hash;
+        auto it = old_hashes.find({z, x, y});
+        if (it != old_hashes.end() && it->second == hash && std::filesystem::exists(file)) { unchanged++; return; }
+    }
+    std::filesystem::create_directories(std::filesystem::path(file).parent_path());
+    PngWriter png(file, kTile, kTile, 3, kTile);
+    png.strip(0, rgb.data());
+    if (!png.close()) { std::cerr << "Failed to save " << file << "\n"; exit(1); }
+    written++;
+}
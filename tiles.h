@@ -0,0 +1,69 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include "map_render.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Zoomable map tiles: dir/<z>/<x>/<y>.png, 256×256 pixels each. The deepest zoom is one
+// pixel per block (16×16 chunks per tile); every lower zoom is built by 2×2 averaging the
+// four tiles below it, never by rendering again. Tiles are built while the world is
+// generated: each row of deepest tiles is rendered as soon as its 16 chunk rows are
+// final, and each zoom keeps only the even row waiting for its partner. Memory stays at
+// about two rows of tiles whatever the world size, so regions can still be streamed out.
+//
+// dir/manifest.txt keeps a hash of every tile, and tiles whose pixels did not change
+// since the last run are not encoded or written again. If the manifest was written for
+// the same chunk contents (key and world size), deepest tiles whose chunks all resumed
+// from the stage cache are not rendered either, and parents whose children are all
+// unchanged are not rebuilt; their pixels are read back from disk only when a changed
+// sibling needs them. index.html is a minimal viewer for the result.
+struct TilePyramid {
+    std::string dir;
+    static const int kTile = 256;
+
+    std::atomic<int> written{0}, unchanged{0}, rendered{0};
+
+    // Starts a pyramid over chunks [0, chunks_x) × [0, chunks_z); key identifies the
+    // generated chunk contents.
+    void begin(int chunks_x, int chunks_z, uint64_t key);
+    // Deepest tile row ty, chunk rows [16*ty, 16*ty + 16), which must be final and
+    // resident. Rows are added in order. clean, if not empty, flags the chunks (row-major,
+    // chunks_x wide) known to be unchanged since the run that wrote the manifest.
+    void addRow(const World& world, int ty, const MapColors& colors, const std::vector<uint8_t>& clean, int threads);
+    // Builds the zooms still waiting for rows below the world and writes the manifest.
+    void finish(int threads);
+
+    // A tile's pixels; empty outside the world. A clean tile is the one on disk, and its
+    // pixels are only loaded when needed.
+    struct Tile {
+        std::vector<uint8_t> rgb;
+        bool clean = false;
+    };
+
+    int max_zoom = 0;
+    int chunks_x = 0, chunks_z = 0;
+    int width = 0, depth = 0; // world size in blocks
+    bool reuse = false;       // manifest matches the chunk contents
+    uint64_t key = 0;
+    std::map<std::tuple<int, int, int>, uint64_t> old_hashes, hashes;
+    std::mutex lock;
+    std::vector<std::vector<Tile>> pending; // per zoom, even row waiting for its partner
+    std::vector<int16_t> north_edge;        // last heightmap row above the next tile row
+    std::vector<int> pending_y;
+
+    int tilesAcross(int z) const;
+    std::string path(int z, int x, int y) const;
+    void addLevelRow(int z, int y, std::vector<Tile> row, int threads);
+    void parentRow(int z, int y, std::vector<Tile>& top, std::vector<Tile>* bottom, int threads);
+    Tile parent(int z, int x, int y, Tile* const* children);
+    bool keep(int z, int x, int y); // reuses the manifest entry of an unchanged tile
+    void load(int z, int x, int y, Tile& tile);
+    void store(int z, int x, int y, const std::vector<uint8_t>& rgb);
+};
+
+#endif
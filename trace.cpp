@@ -0,0 +1,92 @@
+#include "trace.h"
+#include <atomic>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+static const uint64_t kRingSize = 1 << 17; // events per thread lane
+
+struct Event {
+    const char* name;
+    uint64_t begin, end;
+};
+
+struct Ring {
+    std::vector<Event> events = std::vector<Event>(kRingSize);
+    std::atomic<uint64_t> head{0}; // events ever written; only the owner thread stores
+};
+
+// Rings are only taken and returned at thread start and exit, so the lock is off the
+// recording path.
+static std::mutex rings_lock;
+static std::vector<std::unique_ptr<Ring>> rings;
+static std::vector<Ring*> free_rings;
+static const uint64_t epoch = now();
+
+struct Lane {
+    Ring* ring = nullptr;
+    ~Lane() {
+        if (!ring) return;
+        std::lock_guard<std::mutex> g(rings_lock);
+        free_rings.push_back(ring);
+    }
+};
+static thread_local Lane lane;
+
+uint64_t now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void record(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+    Ring* r = lane.ring;
+    if (!r) {
+        std::lock_guard<std::mutex> g(rings_lock);
+        if (!free_rings.empty()) {
+            r = free_rings.back();
+            free_rings.pop_back();
+        } else {
+            rings.push_back(std::make_unique<Ring>());
+            r = rings.back().get();
+        }
+        lane.ring = r;
+    }
+    uint64_t h = r->head.load(std::memory_order_relaxed);
+    r->events[h % kRingSize] = {name, begin_ns, end_ns};
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+void dump(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) { std::cerr << "Cannot open " << path << "\n"; exit(1); }
+    std::lock_guard<std::mutex> g(rings_lock);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char* sep = "\n";
+    uint64_t dropped = 0;
+    for (size_t t = 0; t < rings.size(); t++) {
+        const Ring& r = *rings[t];
+        out << sep << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+            << ", \"args\": {\"name\": \"worker " << t << "\"}}";
+        sep = ",\n";
+        uint64_t head = r.head.load(std::memory_order_acquire);
+        uint64_t first = head > kRingSize ? head - kRingSize : 0;
+        dropped += first;
+        for (uint64_t i = first; i < head; i++) {
+            const Event& e = r.events[i % kRingSize];
+            // Microseconds to 0.1.
+            out << sep << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << t
+                << ", \"ts\": " << (e.begin - epoch) / 1000 << "." << (e.begin - epoch) % 1000 / 100
+                << ", \"dur\": " << (e.end - e.begin) / 1000 << "." << (e.end - e.begin) % 1000 / 100 << "}";
+        }
+    }
+    out << "\n]}\n";
+    if (dropped) std::cerr << "Trace rings overflowed, " << dropped << " oldest events dropped\n";
+}
+
+}
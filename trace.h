@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+// Timeline spans in Chrome trace-event format, for finding where workers idle. Built
+// in with -DMCA_TRACE; otherwise TRACE_SCOPE expands to nothing and record() is never
+// called. Each thread appends to its own ring buffer with no locking (the oldest
+// events are overwritten once it is full); rings are handed back when their thread
+// exits and reused by the next one, so a ring is one timeline lane ("worker N").
+namespace trace {
+
+#ifdef MCA_TRACE
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+uint64_t now(); // CLOCK_MONOTONIC, ns
+// name must outlive the dump (a string literal).
+void record(const char* name, uint64_t begin_ns, uint64_t end_ns);
+// Writes every ring as JSON for Perfetto / chrome://tracing. Call with no spans open
+// on other threads.
+void dump(const std::string& path);
+
+struct Span {
+    const char* name;
+    uint64_t begin;
+    explicit Span(const char* name_) : name(name_), begin(now()) {}
+    ~Span() { record(name, begin, now()); }
+};
+
+}
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#ifdef MCA_TRACE
+#define TRACE_SCOPE(name) trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) do {} while (0)
+#endif
+
+#endif
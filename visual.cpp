@@ -1,86 +1,59 @@
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#include "noise.h"
+#include "parallel.h"
+#include "png_writer.h"
 #include <vector>
 #include <iostream>
 #include <algorithm>
-#include <random>
 
-float fade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
-
-float lerp(float a, float b, float t) { return a + t * (b - a); }
-
-float grad(int hash, float x, float y) {
-    int h = hash & 7;
-    float u = h < 4 ? x : y;
-    float v = h < 4 ? y : x;
-    return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f * v : 2.0f * v);
-}
-
-float perlin(float x, float y, int seed = 5) {
-    int xi = (int)std::floor(x) & 255;
-    int yi = (int)std::floor(y) & 255;
-
-    float xf = x - std::floor(x);
-    float yf = y - std::floor(y);
-
-    float u = fade(xf);
-    float v = fade(yf);
-
-    static uint8_t p[512];
-    static bool initialized = false;
-    if (!initialized) {
-        for (int i = 0; i < 256; i++) p[i] = i;
-        std::shuffle(p, p + 256, std::mt19937(seed));
-        for (int i = 0; i < 256; i++) p[256 + i] = p[i];
-        initialized = true;
+int main(int argc, char** argv) {
+    int coarse = 1;     // noise lattice spacing in pixels, 1 = every pixel
+    bool cubic = false; // bicubic instead of bilinear coarse interpolation
+    int size = 512 * 2; // image width and height in pixels
+    int threads = defaultThreads();
+    int level = 1;      // zlib level for the PNG
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--coarse" && i + 1 < argc) coarse = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--cubic") cubic = true;
+        else if (arg == "--size" && i + 1 < argc) size = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc) threads = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--level" && i + 1 < argc) level = std::stoi(argv[++i]);
+        else { std::cerr << "Unknown option " << arg << std::endl; return 1; }
     }
 
-    int aa = p[p[xi] + yi];
-    int ab = p[p[xi] + yi + 1];
-    int ba = p[p[xi + 1] + yi];
-    int bb = p[p[xi + 1] + yi + 1];
-
-    float x1 = lerp(grad(aa, xf, yf), grad(ba, xf - 1, yf), u);
-    float x2 = lerp(grad(ab, xf, yf - 1), grad(bb, xf - 1, yf - 1), u);
-
-    return (lerp(x1, x2, v) + 1.0f) * 0.5f; // normalize 0..1
-}
-
-float fbm(float x, float y, int octaves = 4, float lacunarity = 2.0f, float gain = 0.5f) {
-    float total = 0.0f, amplitude = 1.0f, frequency = 1.0f;
-    for (int i = 0; i < octaves; ++i) {
-        total += perlin(x * frequency, y * frequency) * amplitude;
-        amplitude *= gain;
-        frequency *= lacunarity;
-    }
-    return total / ((1.0f - std::pow(gain, octaves)) / (1.0f - gain));
-}
-
-
-int main() {
-    const int width = 512 * 2, height = 512 * 2;
+    const int width = size, height = size;
     const std::string filename = "heightmap.png";
-    std::vector<std::vector<unsigned char>> pixels(height, std::vector<unsigned char>(width));
     const float scale = 0.002f;
-    for (int z = 0; z < height; z++) {
-        for (int x = 0; x < width; x++) {
-            float h = fbm(x * scale, z * scale, 5);
-            pixels[z][x] = h*255; // Grayscale value
-        }
-    }
 
-    std::vector<unsigned char> image_data(width * height * 3); // 3 channels (RGB)
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int index = (y * width + x) * 3; // Index for RGB
-            image_data[index] = 0;  // Red channel = 0
-            image_data[index + 1] = (pixels[y][x] > 150) ? pixels[y][x] : 0; // Green channel = original value
-            image_data[index + 2] = (pixels[y][x] > 150) ? 0 : pixels[y][x];;       // Blue channel = 0
+    // Bands of rows in parallel: noise into per-worker scratch, then straight to RGB
+    // and into the PNG stream, so the full image is never held.
+    const int band = 16;
+    PngWriter png(filename, width, height, 3, band, level);
+    std::vector<std::vector<float>> scratch(threads, std::vector<float>(width * band));
+    std::vector<std::vector<unsigned char>> rgb(threads, std::vector<unsigned char>(width * band * 3));
+    std::vector<float> xs(width);
+    for (int x = 0; x < width; x++) xs[x] = x * scale;
+    parallelFor((height + band - 1) / band, threads, [&](int b, int worker) {
+        int z0 = b * band, rows = std::min(band, height - z0);
+        float* hs = scratch[worker].data();
+        if (coarse > 1) {
+            sampleCoarse([&](int x, int z) { return fbm(x * scale, z * scale, 5); }, 0, z0, width, rows, coarse, cubic, hs);
+        } else {
+            float zs[band];
+            for (int z = 0; z < rows; z++) zs[z] = (z0 + z) * scale;
+            fbmGrid(xs.data(), width, zs, rows, hs, 5);
         }
-    }
+        for (int i = 0; i < width * rows; i++) {
+            unsigned char v = hs[i]*255; // Grayscale value
+            unsigned char* px = &rgb[worker][i * 3];
+            px[0] = 0;
+            px[1] = v > 150 ? v : 0; // land in green
+            px[2] = v > 150 ? 0 : v; // water in blue
+        }
+        png.strip(b, rgb[worker].data());
+    });
 
-    // Save as PNG
-    if (stbi_write_png(filename.c_str(), width, height, 3, image_data.data(), width * 3) == 0) {
+    if (!png.close()) {
         std::cerr << "Failed to save " << filename << std::endl;
         return 1;
     }